@@ -14,6 +14,7 @@ Requires:       connman-qt5 >= 1.2.21
 Requires:       user-managerd >= 0.4.0
 Requires:       udisks2 >= 2.8.1+git6
 Requires(post): coreutils
+BuildRequires:  pkgconfig(Qt5Concurrent)
 BuildRequires:  pkgconfig(Qt5Qml)
 BuildRequires:  pkgconfig(Qt5SystemInfo)
 BuildRequires:  pkgconfig(Qt5Test)
@@ -109,6 +110,9 @@ fi
 %files tests
 %defattr(-,root,root,-)
 %{_libdir}/%{name}-tests/ut_diskusage
+%{_libdir}/%{name}-tests/ut_vpnprovisioning
+%{_libdir}/%{name}-tests/ut_vpnstatecounter
+%{_libdir}/%{name}-tests/ut_usermodelrows
 %{_datadir}/%{name}-tests/tests.xml
 
 %files ts-devel
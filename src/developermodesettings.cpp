@@ -37,12 +37,29 @@
 
 #include <QFile>
 #include <QDir>
-#include <QDBusReply>
+#include <QFileInfo>
+#include <QDBusConnection>
+#include <QDBusMessage>
+#include <QDBusPendingCallWatcher>
 #include <QNetworkInterface>
+#include <QSocketNotifier>
 #include <transaction.h>
 
+#include <arpa/inet.h>
+#include <errno.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <net/if.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
 /* Symbolic constants */
 #define PROGRESS_INDETERMINATE (-1)
+/* Share of the reported progress, per transaction running at the same time */
+#define PROGRESS_WEIGHT_COMMAND 4
+#define PROGRESS_WEIGHT_PREFETCH 1
 
 /* Interfaces for IP addresses */
 #define USB_NETWORK_FALLBACK_INTERFACE "usb0"
@@ -70,15 +87,16 @@
 
 /* Package which will move debug folder to /home/.system/usr/lib */
 #define DEBUG_HOME_PACKAGE "jolla-developer-mode-home-debug-location"
+#define DEBUG_HOME_PROVIDED_DIR "/home/.system/usr/lib/debug"
 
-static QMap<QString,QString> enumerate_network_interfaces()
+static QHash<QString,QStringList> enumerate_network_interfaces()
 {
-    QMap<QString,QString> result;
+    QHash<QString,QStringList> result;
 
     for (const QNetworkInterface &intf : QNetworkInterface::allInterfaces()) {
         for (const QNetworkAddressEntry &entry : intf.addressEntries()) {
             if (entry.ip().protocol() == QAbstractSocket::IPv4Protocol) {
-                result[intf.name()] = entry.ip().toString();
+                result[intf.name()].append(entry.ip().toString());
             }
         }
     }
@@ -100,7 +118,7 @@ static QString get_cached_package(const QString &version)
 namespace {
     bool debugHomeFolderExists()
     {
-        QDir pathDir("/home/.system/usr/lib/debug");
+        QDir pathDir(DEBUG_HOME_PROVIDED_DIR);
         if (pathDir.exists()) {
             return true;
         }
@@ -110,10 +128,14 @@ namespace {
 
 DeveloperModeSettings::DeveloperModeSettings(QObject *parent)
     : QObject(parent)
-    , m_usbModeDaemon(USB_MODED_SERVICE, USB_MODED_PATH, USB_MODED_INTERFACE, QDBusConnection::systemBus())
     , m_wlanIpAddress("-")
     , m_usbInterface(USB_NETWORK_FALLBACK_INTERFACE)
     , m_usbIpAddress(USB_NETWORK_FALLBACK_IP)
+    , m_usbConfigIpAddress(USB_NETWORK_FALLBACK_IP)
+    , m_netlinkFd(-1)
+    , m_netlinkNotifier(nullptr)
+    , m_inotifyFd(-1)
+    , m_inotifyNotifier(nullptr)
     , m_username(qgetenv("USER"))
     , m_developerModeEnabled(QFile::exists(DEVELOPER_MODE_PROVIDED_FILE))
     , m_workStatus(Idle)
@@ -122,6 +144,8 @@ DeveloperModeSettings::DeveloperModeSettings(QObject *parent)
     , m_transactionStatus(PackageKit::Transaction::StatusUnknown)
     , m_refreshedForInstall(false)
     , m_localInstallFailed(false)
+    , m_prefetchResolved(true)
+    , m_remoteInstallPending(false)
     , m_localDeveloperModePackagePath(get_cached_package(QStringLiteral("*")))  // Initialized to possibly incompatible package
     , m_debugHomeEnabled(debugHomeFolderExists())
     , m_installationType(None)
@@ -143,14 +167,38 @@ DeveloperModeSettings::DeveloperModeSettings(QObject *parent)
         });
     }
 
+    if (!watchAddresses()) {
+        qCWarning(lcDeveloperModeLog) << "Unable to watch IP address changes, addresses are updated on refresh only";
+    }
     refresh();
 
-    // TODO: Watch WLAN / USB IP addresses for changes
-    // TODO: Watch package manager for changes to developer mode
+    // Packages may be installed and removed by others as well, follow the
+    // transactions and the files the packages provide. Own transactions
+    // update the state once done, avoid flickering in between.
+    PackageKit::Daemon *daemon = PackageKit::Daemon::global();
+    connect(daemon, &PackageKit::Daemon::transactionListChanged, this, [this](const QStringList &transactions) {
+        if (transactions.isEmpty() && m_workStatus == Idle) {
+            updatePackageState();
+        }
+    });
+    connect(daemon, &PackageKit::Daemon::updatesChanged, this, [this] {
+        if (m_workStatus == Idle) {
+            updatePackageState();
+        }
+    });
+    watchPackageFiles();
 }
 
 DeveloperModeSettings::~DeveloperModeSettings()
 {
+    if (m_netlinkFd >= 0) {
+        delete m_netlinkNotifier;
+        close(m_netlinkFd);
+    }
+    if (m_inotifyFd >= 0) {
+        delete m_inotifyNotifier;
+        close(m_inotifyFd);
+    }
 }
 
 QString DeveloperModeSettings::wlanIpAddress() const
@@ -258,6 +306,7 @@ void DeveloperModeSettings::setUsbIpAddress(const QString &usbIpAddress)
 {
     if (m_usbIpAddress != usbIpAddress) {
         usbModedSetConfig(USB_MODED_CONFIG_IP, usbIpAddress);
+        m_usbConfigIpAddress = usbIpAddress;
         m_usbIpAddress = usbIpAddress;
         emit usbIpAddressChanged();
     }
@@ -265,45 +314,225 @@ void DeveloperModeSettings::setUsbIpAddress(const QString &usbIpAddress)
 
 void DeveloperModeSettings::refresh()
 {
-    /* Retrieve network configuration from usb_moded */
-    m_usbInterface = usbModedGetConfig(USB_MODED_CONFIG_INTERFACE, USB_NETWORK_FALLBACK_INTERFACE);
-    QString usbIp = usbModedGetConfig(USB_MODED_CONFIG_IP, USB_NETWORK_FALLBACK_IP);
+    /* Retrieve network configuration from usb_moded, addresses are updated when the replies arrive */
+    usbModedGetConfig(USB_MODED_CONFIG_INTERFACE);
+    usbModedGetConfig(USB_MODED_CONFIG_IP);
+
+    /* Retrieve network configuration from interfaces, unless followed from rtnetlink */
+    if (m_netlinkFd < 0) {
+        m_interfaceAddresses = enumerate_network_interfaces();
+    }
+
+    updateIpAddresses();
+}
 
-    if (usbIp != m_usbIpAddress) {
+void DeveloperModeSettings::updateIpAddresses()
+{
+    QString usbIp = m_interfaceAddresses.value(m_usbInterface).value(0);
+    if (usbIp.isEmpty()) {
+        usbIp = m_usbConfigIpAddress;
+    }
+    if (m_usbIpAddress != usbIp) {
         m_usbIpAddress = usbIp;
         emit usbIpAddressChanged();
     }
 
-    /* Retrieve network configuration from interfaces */
-    QMap<QString,QString> entries = enumerate_network_interfaces();
+    // If the WLAN network interface does not have an IP address,
+    // but there is a "tether" interface that does have an IP, assume
+    // it is the WLAN interface in tethering mode, and use its IP.
+    QString wlanIp = m_interfaceAddresses.value(WLAN_NETWORK_INTERFACE).value(0);
+    if (wlanIp.isEmpty()) {
+        wlanIp = m_interfaceAddresses.value(WLAN_NETWORK_FALLBACK_INTERFACE).value(0, QStringLiteral("-"));
+    }
+    if (m_wlanIpAddress != wlanIp) {
+        m_wlanIpAddress = wlanIp;
+        emit wlanIpAddressChanged();
+    }
+}
+
+/*
+ * Subscribes to IPv4 address changes and requests the current addresses
+ *
+ * Both arrive on the same socket and are handled by readAddressChanges.
+ */
+bool DeveloperModeSettings::watchAddresses()
+{
+    int fd = socket(AF_NETLINK, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (fd < 0) {
+        qCWarning(lcDeveloperModeLog) << "Unable to open rtnetlink socket:" << strerror(errno);
+        return false;
+    }
+
+    struct sockaddr_nl address;
+    memset(&address, 0, sizeof(address));
+    address.nl_family = AF_NETLINK;
+    address.nl_groups = RTMGRP_IPV4_IFADDR;
+    if (bind(fd, reinterpret_cast<struct sockaddr *>(&address), sizeof(address)) < 0) {
+        qCWarning(lcDeveloperModeLog) << "Unable to bind rtnetlink socket:" << strerror(errno);
+        close(fd);
+        return false;
+    }
+
+    struct {
+        struct nlmsghdr header;
+        struct ifaddrmsg message;
+    } request;
+    memset(&request, 0, sizeof(request));
+    request.header.nlmsg_len = NLMSG_LENGTH(sizeof(struct ifaddrmsg));
+    request.header.nlmsg_type = RTM_GETADDR;
+    request.header.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    request.message.ifa_family = AF_INET;
+    if (send(fd, &request, request.header.nlmsg_len, 0) < 0) {
+        qCWarning(lcDeveloperModeLog) << "Unable to request addresses from rtnetlink:" << strerror(errno);
+        close(fd);
+        return false;
+    }
+
+    m_netlinkFd = fd;
+    m_netlinkNotifier = new QSocketNotifier(fd, QSocketNotifier::Read, this);
+    connect(m_netlinkNotifier, &QSocketNotifier::activated, this, &DeveloperModeSettings::readAddressChanges);
+    return true;
+}
+
+void DeveloperModeSettings::readAddressChanges()
+{
+    alignas(struct nlmsghdr) char buffer[8192];
+    bool changed = false;
+
+    ssize_t length;
+    while ((length = recv(m_netlinkFd, buffer, sizeof(buffer), 0)) > 0) {
+        int remaining = length;
+        for (struct nlmsghdr *header = reinterpret_cast<struct nlmsghdr *>(buffer);
+             NLMSG_OK(header, remaining); header = NLMSG_NEXT(header, remaining)) {
+            if (header->nlmsg_type != RTM_NEWADDR && header->nlmsg_type != RTM_DELADDR)
+                continue;
+
+            const struct ifaddrmsg *message = static_cast<const struct ifaddrmsg *>(NLMSG_DATA(header));
+            if (message->ifa_family != AF_INET)
+                continue;
+
+            // IFA_LOCAL is the address of the interface, IFA_ADDRESS is the peer on point-to-point links
+            QString ip;
+            int attributesLength = IFA_PAYLOAD(header);
+            for (const struct rtattr *attribute = IFA_RTA(message); RTA_OK(attribute, attributesLength);
+                 attribute = RTA_NEXT(attribute, attributesLength)) {
+                if (attribute->rta_type == IFA_LOCAL || (attribute->rta_type == IFA_ADDRESS && ip.isEmpty())) {
+                    char text[INET_ADDRSTRLEN];
+                    if (inet_ntop(AF_INET, RTA_DATA(attribute), text, sizeof(text)))
+                        ip = QString::fromLatin1(text);
+                }
+            }
+
+            if (ip.isEmpty())
+                continue;
 
-    if (entries.contains(m_usbInterface)) {
-        QString ip = entries[m_usbInterface];
-        if (m_usbIpAddress != ip) {
-            m_usbIpAddress = ip;
-            emit usbIpAddressChanged();
+            char name[IF_NAMESIZE];
+            QString interface;
+            const bool linkExists = if_indextoname(message->ifa_index, name);
+            if (linkExists) {
+                interface = QString::fromLatin1(name);
+                m_interfaceNames.insert(message->ifa_index, interface);
+            } else {
+                // Addresses are removed after the link is gone, use the name it had
+                interface = m_interfaceNames.value(message->ifa_index);
+                if (interface.isEmpty())
+                    continue;
+            }
+
+            QStringList &addresses = m_interfaceAddresses[interface];
+            addresses.removeAll(ip);
+            if (header->nlmsg_type == RTM_NEWADDR) {
+                addresses.prepend(ip);
+            } else if (addresses.isEmpty()) {
+                m_interfaceAddresses.remove(interface);
+                if (!linkExists)
+                    m_interfaceNames.remove(message->ifa_index);
+            }
+            qCDebug(lcDeveloperModeLog) << "Device:" << interface << "IP:" << ip
+                                        << (header->nlmsg_type == RTM_NEWADDR ? "added" : "removed");
+            changed = true;
         }
     }
 
-    if (entries.contains(WLAN_NETWORK_INTERFACE)) {
-        QString ip = entries[WLAN_NETWORK_INTERFACE];
-        if (m_wlanIpAddress != ip) {
-            m_wlanIpAddress = ip;
-            emit wlanIpAddressChanged();
+    if (length < 0 && errno == ENOBUFS) {
+        // Missed some changes, start over from the current addresses
+        qCWarning(lcDeveloperModeLog) << "rtnetlink buffer overrun, reading all addresses";
+        m_interfaceAddresses = enumerate_network_interfaces();
+        m_interfaceNames.clear();
+        for (auto it = m_interfaceAddresses.constBegin(); it != m_interfaceAddresses.constEnd(); ++it) {
+            if (unsigned int index = if_nametoindex(it.key().toLatin1().constData()))
+                m_interfaceNames.insert(index, it.key());
         }
-    } else if (entries.contains(WLAN_NETWORK_FALLBACK_INTERFACE)) {
-        // If the WLAN network interface does not have an IP address,
-        // but there is a "tether" interface that does have an IP, assume
-        // it is the WLAN interface in tethering mode, and use its IP.
-        QString ip = entries[WLAN_NETWORK_FALLBACK_INTERFACE];
-        if (m_wlanIpAddress != ip) {
-            m_wlanIpAddress = ip;
-            emit wlanIpAddressChanged();
+        changed = true;
+    }
+
+    if (changed) {
+        updateIpAddresses();
+    }
+}
+
+/*
+ * Watches the directories holding the files the packages provide
+ *
+ * Catches changes made without PackageKit, e.g. with rpm directly.
+ * A file that does not exist yet is watched through its nearest existing
+ * parent directory; watches are added again after each change so that
+ * they follow the directories as they are created and removed.
+ */
+void DeveloperModeSettings::watchPackageFiles()
+{
+    if (m_inotifyFd < 0) {
+        m_inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (m_inotifyFd < 0) {
+            qCWarning(lcDeveloperModeLog) << "Unable to watch package files:" << strerror(errno);
+            return;
+        }
+        m_inotifyNotifier = new QSocketNotifier(m_inotifyFd, QSocketNotifier::Read, this);
+        connect(m_inotifyNotifier, &QSocketNotifier::activated, this, &DeveloperModeSettings::readPackageChanges);
+    }
+
+    const uint32_t mask = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR;
+    for (const char *file : { DEVELOPER_MODE_PROVIDED_FILE, DEBUG_HOME_PROVIDED_DIR }) {
+        QDir dir(QFileInfo(QString::fromLatin1(file)).absolutePath());
+        while (!dir.exists() && !dir.isRoot()) {
+            dir.cdUp();
+        }
+        if (inotify_add_watch(m_inotifyFd, QFile::encodeName(dir.absolutePath()).constData(), mask) < 0) {
+            qCWarning(lcDeveloperModeLog) << "Unable to watch" << dir.absolutePath() << strerror(errno);
         }
     }
+}
+
+void DeveloperModeSettings::readPackageChanges()
+{
+    alignas(struct inotify_event) char buffer[4096];
+    bool changed = false;
 
-    for (const QString &device : entries.keys()) {
-        qCDebug(lcDeveloperModeLog) << "Device:" << device << "IP:" << entries[device];
+    // Which file changed does not matter, existence checks are cheap
+    while (read(m_inotifyFd, buffer, sizeof(buffer)) > 0) {
+        changed = true;
+    }
+
+    if (changed) {
+        watchPackageFiles();
+        if (m_workStatus == Idle) {
+            updatePackageState();
+        }
+    }
+}
+
+void DeveloperModeSettings::updatePackageState()
+{
+    bool enabled = QFile::exists(DEVELOPER_MODE_PROVIDED_FILE);
+    if (m_developerModeEnabled != enabled) {
+        m_developerModeEnabled = enabled;
+        emit developerModeEnabledChanged();
+    }
+
+    enabled = debugHomeFolderExists();
+    if (m_debugHomeEnabled != enabled) {
+        m_debugHomeEnabled = enabled;
+        emit debugHomeEnabledChanged();
     }
 }
 
@@ -341,16 +570,20 @@ void DeveloperModeSettings::resolveAndExecute(Command command)
             qCDebug(lcDeveloperModeLog) << "Preload package version: " << version << ", local package path: " << m_localDeveloperModePackagePath;
         });
 
+        // The repository package does not depend on the preload version, resolve it
+        // at the same time and have it downloaded in case the local install fails
+        prefetchPackage();
+
         connect(resolvePackage, &PackageKit::Transaction::finished,
                 this, [this](PackageKit::Transaction::Exit status, uint runtime) {
             Q_UNUSED(runtime)
             if (status != PackageKit::Transaction::ExitSuccess || m_localDeveloperModePackagePath.isEmpty()) {
                 qCDebug(lcDeveloperModeLog) << "Preloaded package not found, must use remote package";
                 // No cached package => install from repos
-                resolveAndExecute(InstallCommand);
+                installRemotePackage();
             } else {
                 PackageKit::Transaction *tx = PackageKit::Daemon::installFiles(QStringList() << m_localDeveloperModePackagePath);
-                connectCommandSignals(tx);
+                connectCommandSignals(tx, PROGRESS_WEIGHT_COMMAND);
                 connect(tx, &PackageKit::Transaction::finished,
                         this, [this](PackageKit::Transaction::Exit status, uint runtime) {
                     if (status == PackageKit::Transaction::ExitSuccess) {
@@ -360,7 +593,7 @@ void DeveloperModeSettings::resolveAndExecute(Command command)
                         qCWarning(lcDeveloperModeLog) << "Developer mode installation from local package failed, trying from repos";
                         m_localInstallFailed = true;
                         emit repositoryAccessRequiredChanged();
-                        resolveAndExecute(InstallCommand);  // TODO: If repo access is not available this can not bail out
+                        installRemotePackage();  // TODO: If repo access is not available this can not bail out
                     } // else ExitUnknown (ignored)
                 });
             }
@@ -372,6 +605,65 @@ void DeveloperModeSettings::resolveAndExecute(Command command)
     }
 }
 
+/*
+ * Resolves the repository package and downloads it to the package cache
+ *
+ * Runs next to the local package installation, whose progress dominates
+ * the reported progress until it fails and the prefetched package is used.
+ */
+void DeveloperModeSettings::prefetchPackage()
+{
+    m_prefetchResolved = false;
+    m_remoteInstallPending = false;
+
+    PackageKit::Transaction *resolvePackage = PackageKit::Daemon::resolve(packageName(), PackageKit::Transaction::FilterNewest);
+    connect(resolvePackage, &PackageKit::Transaction::errorCode, this, &DeveloperModeSettings::reportTransactionErrorCode);
+    connect(resolvePackage, &PackageKit::Transaction::package,
+            this, [this](PackageKit::Transaction::Info info, const QString &packageId, const QString &summary) {
+        qCDebug(lcDeveloperModeLog) << "Package transaction:" << info << packageId << "summary:" << summary;
+        m_packageId = packageId;
+    });
+    connect(resolvePackage, &PackageKit::Transaction::finished,
+            this, [this](PackageKit::Transaction::Exit status, uint runtime) {
+        Q_UNUSED(runtime)
+        m_prefetchResolved = true;
+
+        if (m_workStatus == Idle) {
+            // Local package got installed already
+            return;
+        } else if (m_remoteInstallPending) {
+            // Local install gave up while resolving
+            m_remoteInstallPending = false;
+            installRemotePackage();
+        } else if (status != PackageKit::Transaction::ExitSuccess || m_packageId.isEmpty()) {
+            qCDebug(lcDeveloperModeLog) << "Remote package did not resolve, not prefetching";
+        } else {
+            PackageKit::Transaction *prefetch = PackageKit::Daemon::downloadPackage(m_packageId, true);
+            m_prefetch = prefetch;
+            trackProgress(prefetch, PROGRESS_WEIGHT_PREFETCH);
+            connect(prefetch, &PackageKit::Transaction::percentageChanged, this, [this, prefetch] {
+                updateProgress(prefetch, prefetch->percentage());
+            });
+            connect(prefetch, &PackageKit::Transaction::finished,
+                    this, [](PackageKit::Transaction::Exit status, uint runtime) {
+                qCDebug(lcDeveloperModeLog) << "Remote package prefetch done:" << status << runtime;
+            });
+        }
+    });
+}
+
+void DeveloperModeSettings::installRemotePackage()
+{
+    if (!m_prefetchResolved) {
+        // Continued once the repository package is resolved
+        m_remoteInstallPending = true;
+    } else if (m_packageId.isEmpty()) {
+        installAndRemove(InstallCommand);
+    } else {
+        execute(InstallCommand);
+    }
+}
+
 bool DeveloperModeSettings::installAndRemove(Command command) 
 {
     if (packageName().isEmpty()) {
@@ -412,60 +704,117 @@ bool DeveloperModeSettings::installAndRemove(Command command)
                 qCWarning(lcDeveloperModeLog) << "Removing package but package didn't resolve into anything. Shouldn't happen.";
                 resetState();
             }
+        } else {
+            execute(command);
+        }
+    });
+    return true;
+}
 
-        } else if (command == InstallCommand) {
-            PackageKit::Transaction *tx = PackageKit::Daemon::installPackage(m_packageId);
-            connectCommandSignals(tx);
-
-            if (m_refreshedForInstall) {
-                connect(tx, &PackageKit::Transaction::finished,
-                        this, [this](PackageKit::Transaction::Exit status, uint runtime) {
-                    qCDebug(lcDeveloperModeLog) << "Installation transaction done (with refresh):" << status << runtime;
-                    resetState();
-                });
-            } else {
-                connect(tx, &PackageKit::Transaction::finished,
-                        this, [this](PackageKit::Transaction::Exit status, uint runtime) {
-                    if (status == PackageKit::Transaction::ExitSuccess) {
-                        qCDebug(lcDeveloperModeLog) << "Installation transaction done:" << status << runtime;
-                        resetState();
-                    } else {
-                        qCDebug(lcDeveloperModeLog) << "Installation failed, trying again after refresh";
-                        refreshPackageCacheAndInstall();
-                    }
-                });
-            }
+void DeveloperModeSettings::execute(Command command)
+{
+    if (command == InstallCommand) {
+        PackageKit::Transaction *tx = PackageKit::Daemon::installPackage(m_packageId);
+        connectCommandSignals(tx, PROGRESS_WEIGHT_COMMAND);
 
-        } else {
-            PackageKit::Transaction *tx = PackageKit::Daemon::removePackage(m_packageId, true, true);
-            connectCommandSignals(tx);
+        if (m_refreshedForInstall) {
             connect(tx, &PackageKit::Transaction::finished,
                     this, [this](PackageKit::Transaction::Exit status, uint runtime) {
-                qCDebug(lcDeveloperModeLog) << "Package removal transaction done:" << status << runtime;
+                qCDebug(lcDeveloperModeLog) << "Installation transaction done (with refresh):" << status << runtime;
                 resetState();
             });
+        } else {
+            connect(tx, &PackageKit::Transaction::finished,
+                    this, [this](PackageKit::Transaction::Exit status, uint runtime) {
+                if (status == PackageKit::Transaction::ExitSuccess) {
+                    qCDebug(lcDeveloperModeLog) << "Installation transaction done:" << status << runtime;
+                    resetState();
+                } else {
+                    qCDebug(lcDeveloperModeLog) << "Installation failed, trying again after refresh";
+                    refreshPackageCacheAndInstall();
+                }
+            });
         }
-    });
-    return true;
+
+    } else {
+        PackageKit::Transaction *tx = PackageKit::Daemon::removePackage(m_packageId, true, true);
+        connectCommandSignals(tx, PROGRESS_WEIGHT_COMMAND);
+        connect(tx, &PackageKit::Transaction::finished,
+                this, [this](PackageKit::Transaction::Exit status, uint runtime) {
+            qCDebug(lcDeveloperModeLog) << "Package removal transaction done:" << status << runtime;
+            resetState();
+        });
+    }
 }
 
-void DeveloperModeSettings::connectCommandSignals(PackageKit::Transaction *transaction)
+void DeveloperModeSettings::connectCommandSignals(PackageKit::Transaction *transaction, int weight)
 {
+    trackProgress(transaction, weight);
+
     connect(transaction, &PackageKit::Transaction::errorCode, this, &DeveloperModeSettings::reportTransactionErrorCode);
     connect(transaction, &PackageKit::Transaction::percentageChanged, this, [this, transaction]() {
-        updateState(transaction->percentage(), m_transactionStatus, m_transactionRole);
+        updateState(transaction, transaction->percentage(), m_transactionStatus, m_transactionRole);
     });
 
     connect(transaction, &PackageKit::Transaction::statusChanged, this, [this, transaction]() {
-        updateState(m_workProgress, transaction->status(), m_transactionRole);
+        updateState(transaction, transaction->percentage(), transaction->status(), m_transactionRole);
     });
 
     connect(transaction, &PackageKit::Transaction::roleChanged, this, [this, transaction]() {
-        updateState(m_workProgress, m_transactionStatus, transaction->role());
+        updateState(transaction, transaction->percentage(), m_transactionStatus, transaction->role());
     });
 }
 
-void DeveloperModeSettings::updateState(int percentage, PackageKit::Transaction::Status status, PackageKit::Transaction::Role role)
+void DeveloperModeSettings::trackProgress(PackageKit::Transaction *transaction, int weight)
+{
+    TransactionProgress &tracked = m_transactionProgress[transaction];
+    tracked.weight = weight;
+    tracked.progress = 0;
+
+    // Connected first so that this runs before the handlers that continue the work
+    connect(transaction, &PackageKit::Transaction::finished,
+            this, [this, transaction](PackageKit::Transaction::Exit status) {
+        if (status == PackageKit::Transaction::ExitSuccess) {
+            updateProgress(transaction, 100);
+        } else {
+            // Whatever replaces a failed transaction is tracked on its own,
+            // keeping this one would hold the weighted sum below 100%
+            m_transactionProgress.remove(transaction);
+        }
+    });
+}
+
+/*
+ * Updates the progress of one transaction and reports the weighted sum
+ * of all the transactions of the current work
+ */
+void DeveloperModeSettings::updateProgress(PackageKit::Transaction *transaction, int progress)
+{
+    auto it = m_transactionProgress.find(transaction);
+    if (it == m_transactionProgress.end() || progress < 0 || progress > 100) {
+        return;
+    }
+    it->progress = qMax(it->progress, progress);
+
+    int weights = 0;
+    int total = 0;
+    for (const TransactionProgress &tracked : m_transactionProgress) {
+        weights += tracked.weight;
+        total += tracked.weight * tracked.progress;
+    }
+    if (weights > 0) {
+        progress = total / weights;
+    }
+
+    progress = qBound(0, qMax(progress, m_workProgress), 100); // Ensure the emitted progress value never decreases.
+
+    if (m_workProgress != progress) {
+        m_workProgress = progress;
+        emit workProgressChanged();
+    }
+}
+
+void DeveloperModeSettings::updateState(PackageKit::Transaction *transaction, int percentage, PackageKit::Transaction::Status status, PackageKit::Transaction::Role role)
 {
     // Expected changes from PackageKit when installing packages:
     // 1. Change to 'install packages' role or 'install files' if installing from local package file
@@ -486,7 +835,7 @@ void DeveloperModeSettings::updateState(int percentage, PackageKit::Transaction:
     //
     // Notice the 'install' and 'remove' packagekit status changes occur twice.
 
-    int progress = m_workProgress;
+    int progress = -1;
     DeveloperModeSettings::Status workStatus = m_workStatus;
 
     m_transactionRole = role;
@@ -545,31 +894,20 @@ void DeveloperModeSettings::updateState(int percentage, PackageKit::Transaction:
         }
     }
 
-    progress = qBound(0, qMax(progress, m_workProgress), 100); // Ensure the emitted progress value never decreases.
-
     setWorkStatus(workStatus);
-
-    if (m_workProgress != progress) {
-        m_workProgress = progress;
-        emit workProgressChanged();
-    }
+    updateProgress(transaction, progress);
 }
 
 void DeveloperModeSettings::resetState()
 {
-    if (m_installationType == DeveloperMode) {
-        bool enabled = QFile::exists(DEVELOPER_MODE_PROVIDED_FILE);
-        if (m_developerModeEnabled != enabled) {
-            m_developerModeEnabled = enabled;
-            emit developerModeEnabledChanged();
-        }
-    } else if (m_installationType == DebugHome) {
-        if (m_debugHomeEnabled != debugHomeFolderExists()) {
-            m_debugHomeEnabled = debugHomeFolderExists();
-            emit debugHomeEnabledChanged();
-        }
+    if (m_prefetch) {
+        // Local package got installed, the remote one is not needed
+        m_prefetch->cancel();
+        m_prefetch.clear();
     }
+    m_transactionProgress.clear();
 
+    updatePackageState();
     setWorkStatus(Idle);
     setInstallationType(None);
 
@@ -592,20 +930,34 @@ void DeveloperModeSettings::reportTransactionErrorCode(PackageKit::Transaction::
     qCWarning(lcDeveloperModeLog) << "Transaction error:" << code << details;
 }
 
-QString DeveloperModeSettings::usbModedGetConfig(const QString &key, const QString &fallback)
+void DeveloperModeSettings::usbModedGetConfig(const QString &key)
 {
-    QString value = fallback;
-
-    QDBusMessage msg = m_usbModeDaemon.call(USB_MODED_GET_NET_CONFIG, key);
-    QList<QVariant> result = msg.arguments();
-    if (result[0].toString() == key && result.size() == 2) {
-        value = result[1].toString();
-    }
+    QDBusMessage message = QDBusMessage::createMethodCall(USB_MODED_SERVICE, USB_MODED_PATH, USB_MODED_INTERFACE,
+                                                          USB_MODED_GET_NET_CONFIG);
+    message.setArguments(QVariantList() << key);
+
+    QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(QDBusConnection::systemBus().asyncCall(message), this);
+    connect(watcher, &QDBusPendingCallWatcher::finished, this, [this, key](QDBusPendingCallWatcher *watcher) {
+        watcher->deleteLater();
+        const QList<QVariant> result = watcher->reply().arguments();
+        if (watcher->isError() || result.size() != 2 || result[0].toString() != key) {
+            // Keep the cached value
+            return;
+        }
 
-    return value;
+        if (key == QLatin1String(USB_MODED_CONFIG_INTERFACE)) {
+            m_usbInterface = result[1].toString();
+        } else if (key == QLatin1String(USB_MODED_CONFIG_IP)) {
+            m_usbConfigIpAddress = result[1].toString();
+        }
+        updateIpAddresses();
+    });
 }
 
 void DeveloperModeSettings::usbModedSetConfig(const QString &key, const QString &value)
 {
-    m_usbModeDaemon.call(USB_MODED_SET_NET_CONFIG, key, value);
+    QDBusMessage message = QDBusMessage::createMethodCall(USB_MODED_SERVICE, USB_MODED_PATH, USB_MODED_INTERFACE,
+                                                          USB_MODED_SET_NET_CONFIG);
+    message.setArguments(QVariantList() << key << value);
+    QDBusConnection::systemBus().asyncCall(message);
 }
@@ -35,7 +35,9 @@
 #define DEVELOPERMODESETTINGS_H
 
 #include <QObject>
-#include <QDBusInterface>
+#include <QHash>
+#include <QPointer>
+#include <QStringList>
 
 #include <systemsettingsglobal.h>
 #include <daemon.h>
@@ -43,6 +45,7 @@
 
 QT_BEGIN_NAMESPACE
 class QDBusPendingCallWatcher;
+class QSocketNotifier;
 QT_END_NAMESPACE
 
 class SYSTEMSETTINGS_EXPORT DeveloperModeSettings : public QObject
@@ -106,7 +109,9 @@ signals:
 
 private slots:
     void reportTransactionErrorCode(PackageKit::Transaction::Error code, const QString &details);
-    void updateState(int percentage, PackageKit::Transaction::Status status, PackageKit::Transaction::Role role);
+    void updateState(PackageKit::Transaction *transaction, int percentage, PackageKit::Transaction::Status status, PackageKit::Transaction::Role role);
+    void readAddressChanges();
+    void readPackageChanges();
 
 private:
     enum Command {
@@ -114,21 +119,44 @@ private:
         RemoveCommand
     };
 
+    struct TransactionProgress {
+        int weight;
+        int progress;
+    };
+
     void resetState();
     void setWorkStatus(Status status);
     void refreshPackageCacheAndInstall();
     void resolveAndExecute(Command command);
     bool installAndRemove(Command command);
-    void connectCommandSignals(PackageKit::Transaction *transaction);
+    void execute(Command command);
+    void prefetchPackage();
+    void installRemotePackage();
+    void connectCommandSignals(PackageKit::Transaction *transaction, int weight);
+    void trackProgress(PackageKit::Transaction *transaction, int weight);
+    void updateProgress(PackageKit::Transaction *transaction, int progress);
     void setInstallationType(InstallationType type);
 
-    QString usbModedGetConfig(const QString &key, const QString &fallback);
+    void usbModedGetConfig(const QString &key);
     void usbModedSetConfig(const QString &key, const QString &value);
+    bool watchAddresses();
+    void updateIpAddresses();
+    void watchPackageFiles();
+    void updatePackageState();
 
-    QDBusInterface m_usbModeDaemon;
     QString m_wlanIpAddress;
     QString m_usbInterface;
     QString m_usbIpAddress;
+    // Address configured in usb_moded, used while the interface has none
+    QString m_usbConfigIpAddress;
+    // IPv4 addresses of each interface, kept up to date from rtnetlink
+    QHash<QString, QStringList> m_interfaceAddresses;
+    // Names of the interfaces by index, for the addresses removed along with the link
+    QHash<int, QString> m_interfaceNames;
+    int m_netlinkFd;
+    QSocketNotifier *m_netlinkNotifier;
+    int m_inotifyFd;
+    QSocketNotifier *m_inotifyNotifier;
     QString m_username;
     QString m_packageId;
     bool m_developerModeEnabled;
@@ -138,6 +166,11 @@ private:
     PackageKit::Transaction::Status m_transactionStatus;
     bool m_refreshedForInstall;
     bool m_localInstallFailed;
+    bool m_prefetchResolved;
+    bool m_remoteInstallPending;
+    QPointer<PackageKit::Transaction> m_prefetch;
+    // Transactions of the current work, progress is reported as their weighted sum
+    QHash<PackageKit::Transaction *, TransactionProgress> m_transactionProgress;
     QString m_localDeveloperModePackagePath;
     bool m_debugHomeEnabled;
     DeveloperModeSettings::InstallationType m_installationType;
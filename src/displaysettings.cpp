@@ -35,6 +35,7 @@
 #include "displaysettings.h"
 #include <MGConfItem>
 #include <QDebug>
+#include <QTimer>
 
 static const char *MceDisplayBrightness = "/system/osso/dsm/display/display_brightness";
 static const char *MceDisplayDimTimeout = "/system/osso/dsm/display/display_dim_timeout";
@@ -52,8 +53,12 @@ static const char *McePowerSaveModeForced = "/system/osso/dsm/energymanagement/f
 static const char *McePowerSaveModeEnabled = "/system/osso/dsm/energymanagement/enable_power_saving";
 static const char *McePowerSaveModeThreshold = "/system/osso/dsm/energymanagement/psm_threshold";
 
+// Throttled values are written at most once per this interval, MCE persists every write
+static const int MceWriteInterval = 250;
+
 DisplaySettings::DisplaySettings(QObject *parent)
     : QObject(parent)
+    , m_writeTimer(new QTimer(this))
 {
     m_orientationLock = new MGConfItem("/lipstick/orientationLock", this);
     connect(m_orientationLock, SIGNAL(valueChanged()), SIGNAL(orientationLockChanged()));
@@ -76,6 +81,10 @@ DisplaySettings::DisplaySettings(QObject *parent)
     m_powerSaveModeThreshold    = 20;
     m_populated                 = false;
 
+    m_writeTimer->setSingleShot(true);
+    m_writeTimer->setInterval(MceWriteInterval);
+    connect(m_writeTimer, &QTimer::timeout, this, &DisplaySettings::flushWrites);
+
     /* Setup change listener & get current values via async query */
     m_mceSignalIface = new ComNokiaMceSignalInterface(MCE_SERVICE, MCE_SIGNAL_PATH, QDBusConnection::systemBus(), this);
     connect(m_mceSignalIface, SIGNAL(config_change_ind(QString,QDBusVariant)), this, SLOT(configChange(QString,QDBusVariant)));
@@ -87,6 +96,14 @@ DisplaySettings::DisplaySettings(QObject *parent)
                      this, SLOT(configReply(QDBusPendingCallWatcher *)));
 }
 
+DisplaySettings::~DisplaySettings()
+{
+    // Never lose the final value of a slider
+    for (auto it = m_pendingWrites.constBegin(); it != m_pendingWrites.constEnd(); ++it) {
+        m_mceIface->set_config(QDBusObjectPath(it.key()), QDBusVariant(it.value()));
+    }
+}
+
 void DisplaySettings::configReply(QDBusPendingCallWatcher *watcher)
 {
     QDBusPendingReply<QVariantMap> reply =  *watcher;
@@ -117,7 +134,7 @@ void DisplaySettings::setBrightness(int value)
 {
     if (m_brightness != value) {
         m_brightness = value;
-        m_mceIface->set_config(QDBusObjectPath(MceDisplayBrightness), QDBusVariant(value));
+        throttledSetConfig(MceDisplayBrightness, value);
         emit brightnessChanged();
     }
 }
@@ -139,7 +156,7 @@ void DisplaySettings::setDimTimeout(int value)
 {
     if (m_dimTimeout != value) {
         m_dimTimeout = value;
-        m_mceIface->set_config(QDBusObjectPath(MceDisplayDimTimeout), QDBusVariant(value));
+        throttledSetConfig(MceDisplayDimTimeout, value);
         emit dimTimeoutChanged();
     }
 }
@@ -153,7 +170,7 @@ void DisplaySettings::setBlankTimeout(int value)
 {
     if (m_blankTimeout != value) {
         m_blankTimeout = value;
-        m_mceIface->set_config(QDBusObjectPath(MceDisplayBlankTimeout), QDBusVariant(value));
+        throttledSetConfig(MceDisplayBlankTimeout, value);
         emit blankTimeoutChanged();
     }
 }
@@ -342,9 +359,69 @@ bool DisplaySettings::populated() const
 
 void DisplaySettings::configChange(const QString &key, const QDBusVariant &value)
 {
+    if (m_pendingWrites.contains(key)) {
+        // Local value is newer
+        return;
+    }
+
+    auto it = m_writesInFlight.find(key);
+    if (it != m_writesInFlight.end() && it->contains(value.variant())) {
+        // Echo of our own write
+        return;
+    }
+
     updateConfig(key, value.variant());
 }
 
+/*
+ * Writes a value that may change rapidly, e.g. from a slider
+ *
+ * The first value is sent right away, later ones at most once per
+ * MceWriteInterval so that only the latest value of each interval is sent.
+ */
+void DisplaySettings::throttledSetConfig(const QString &key, const QVariant &value)
+{
+    m_pendingWrites.insert(key, value);
+    if (!m_writeTimer->isActive()) {
+        flushWrites();
+    }
+}
+
+void DisplaySettings::flushWrites()
+{
+    if (m_pendingWrites.isEmpty()) {
+        return;
+    }
+
+    for (auto it = m_pendingWrites.constBegin(); it != m_pendingWrites.constEnd(); ++it) {
+        const QString key = it.key();
+        const QVariant value = it.value();
+        m_writesInFlight[key].append(value);
+
+        QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(
+                    m_mceIface->set_config(QDBusObjectPath(key), QDBusVariant(value)), this);
+        connect(watcher, &QDBusPendingCallWatcher::finished, this, [this, key, value](QDBusPendingCallWatcher *watcher) {
+            watcher->deleteLater();
+
+            // MCE has sent the change indication, if any, before the reply
+            QVariantList &values = m_writesInFlight[key];
+            values.removeOne(value);
+            if (values.isEmpty()) {
+                m_writesInFlight.remove(key);
+            }
+
+            QDBusPendingReply<bool> reply = *watcher;
+            if (reply.isError() || !reply.value()) {
+                qWarning() << "Could not set mce setting" << key << reply.error().message();
+            }
+        });
+    }
+    m_pendingWrites.clear();
+
+    // Hold back further writes for an interval
+    m_writeTimer->start();
+}
+
 void DisplaySettings::updateConfig(const QString &key, const QVariant &value)
 {
     if (key == MceDisplayBrightness) {
@@ -39,6 +39,7 @@
 class ComNokiaMceRequestInterface;
 class ComNokiaMceSignalInterface;
 class QDBusVariant;
+class QTimer;
 class MGConfItem;
 
 #include <systemsettingsglobal.h>
@@ -89,6 +90,7 @@ public:
     };
 
     explicit DisplaySettings(QObject *parent = 0);
+    ~DisplaySettings();
 
     int brightness() const;
     void setBrightness(int);
@@ -164,9 +166,11 @@ signals:
 private slots:
     void configChange(const QString &key, const QDBusVariant &value);
     void configReply(QDBusPendingCallWatcher *watcher);
+    void flushWrites();
 
 private:
     void updateConfig(const QString &key, const QVariant &value);
+    void throttledSetConfig(const QString &key, const QVariant &value);
     ComNokiaMceRequestInterface *m_mceIface;
     ComNokiaMceSignalInterface *m_mceSignalIface;
     MGConfItem *m_orientationLock;
@@ -186,6 +190,11 @@ private:
     bool m_powerSaveModeEnabled;
     int m_powerSaveModeThreshold;
     bool m_populated;
+
+    // Throttled values waiting to be written and written values waiting for a reply
+    QHash<QString, QVariant> m_pendingWrites;
+    QHash<QString, QVariantList> m_writesInFlight;
+    QTimer *m_writeTimer;
 };
 
 QML_DECLARE_TYPE(DisplaySettings)
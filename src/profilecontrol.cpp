@@ -29,130 +29,85 @@
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
  */
 
-#include <libprofile.h>
 #include "profilecontrol.h"
-#include <QDebug>
-
-// NOTE: most of profiled interface blocks
-
-
-const char * const VolumeKey = "ringing.alert.volume";
-const char * const VibraKey = "vibrating.alert.enabled";
-const char * const SystemSoundLevelKey = "system.sound.level";
-const char * const TouchscreenToneLevelKey = "touchscreen.sound.level";
-const char * const TouchscreenVibrationLevelKey = "touchscreen.vibration.level";
-
-const char * const RingerToneKey = "ringing.alert.tone";
-const char * const MessageToneKey ="sms.alert.tone";
-const char * const ChatToneKey ="im.alert.tone";
-const char * const MailToneKey ="email.alert.tone";
-const char * const InternetCallToneKey ="voip.alert.tone";
-const char * const CalendarToneKey ="calendar.alert.tone";
-const char * const ClockAlarmToneKey ="clock.alert.tone";
-
-const char * const RingerToneEnabledKey = "ringing.alert.enabled";
-const char * const MessageToneEnabledKey ="sms.alert.enabled";
-const char * const ChatToneEnabledKey ="im.alert.enabled";
-const char * const MailToneEnabledKey ="email.alert.enabled";
-const char * const InternetCallToneEnabledKey ="voip.alert.enabled";
-const char * const CalendarToneEnabledKey ="calendar.alert.enabled";
-const char * const ClockAlarmToneEnabledKey ="clock.alert.enabled";
-
-const char * const GeneralProfile = "general";
-const char * const SilentProfile = "silent";
-
-int ProfileControl::s_instanceCounter = 0;
-
+#include "profilestore_p.h"
 
 ProfileControl::ProfileControl(QObject *parent)
-    : QObject(parent),
-      m_systemSoundLevel(-1),
-      m_touchscreenToneLevel(-1),
-      m_touchscreenVibrationLevel(-1),
-      m_ringerToneEnabled(-1),
-      m_messageToneEnabled(-1),
-      m_chatToneEnabled(-1),
-      m_mailToneEnabled(-1),
-      m_internetCallToneEnabled(-1),
-      m_calendarToneEnabled(-1),
-      m_clockAlarmToneEnabled(-1)
-{
-    profile_track_add_profile_cb((profile_track_profile_fn_data) currentProfileChangedCallback, this, NULL);
-
-    // track changes in active and inactive profile(s)
-    profile_track_add_active_cb((profile_track_value_fn_data) &updateStateCallBackTrampoline, this, NULL);
-    profile_track_add_change_cb((profile_track_value_fn_data) &updateStateCallBackTrampoline, this, NULL);
-
-    profile_connection_enable_autoconnect();
-
-    if (s_instanceCounter == 0) {
-        profile_tracker_init();
-    }
-    s_instanceCounter++;
-
-    m_ringerVolume = profile_get_value_as_int(GeneralProfile, VolumeKey);
-    m_vibraInGeneral = profile_get_value_as_bool(GeneralProfile, VibraKey);
-    m_vibraInSilent = profile_get_value_as_bool(SilentProfile, VibraKey);
+    : QObject(parent)
+{
+    ProfileStore *store = ProfileStore::instance();
+    connect(store, &ProfileStore::profileChanged, this, &ProfileControl::profileChanged);
+    connect(store, &ProfileStore::valueWriteFailed, this, &ProfileControl::valueWriteFailed);
+    connect(store, &ProfileStore::valueChanged, this, [this](ProfileStore::Value value) {
+        // Indexed by ProfileStore::Value
+        static void (ProfileControl::* const changedSignals[])() = {
+            &ProfileControl::ringerVolumeChanged,
+            &ProfileControl::vibraModeChanged,
+            &ProfileControl::vibraModeChanged,
+            &ProfileControl::systemSoundLevelChanged,
+            &ProfileControl::touchscreenToneLevelChanged,
+            &ProfileControl::touchscreenVibrationLevelChanged,
+            &ProfileControl::ringerToneFileChanged,
+            &ProfileControl::messageToneFileChanged,
+            &ProfileControl::chatToneFileChanged,
+            &ProfileControl::mailToneFileChanged,
+            &ProfileControl::internetCallToneFileChanged,
+            &ProfileControl::calendarToneFileChanged,
+            &ProfileControl::clockAlarmToneFileChanged,
+            &ProfileControl::ringerToneEnabledChanged,
+            &ProfileControl::messageToneEnabledChanged,
+            &ProfileControl::chatToneEnabledChanged,
+            &ProfileControl::mailToneEnabledChanged,
+            &ProfileControl::internetCallToneEnabledChanged,
+            &ProfileControl::calendarToneEnabledChanged,
+            &ProfileControl::clockAlarmToneEnabledChanged
+        };
+        static_assert(sizeof(changedSignals) / sizeof(changedSignals[0]) == ProfileStore::ValueCount,
+                      "Profile change signals do not match the values");
+
+        emit (this->*changedSignals[value])();
+    });
 }
 
 ProfileControl::~ProfileControl()
 {
-    s_instanceCounter--;
-    if (s_instanceCounter == 0) {
-        profile_tracker_quit();
-    }
-
-    profile_track_remove_profile_cb((profile_track_profile_fn_data) currentProfileChangedCallback, this);
-    profile_track_remove_active_cb((profile_track_value_fn_data) &updateStateCallBackTrampoline, this);
-    profile_track_remove_change_cb((profile_track_value_fn_data) &updateStateCallBackTrampoline, this);
 }
 
 QString ProfileControl::profile()
 {
-    if (m_profile.isEmpty()) {
-        m_profile = QString::fromUtf8(profile_get_profile());
-    }
-
-    return m_profile;
+    return ProfileStore::instance()->profile();
 }
 
 void ProfileControl::setProfile(const QString &profile)
 {
-    if (profile != m_profile) {
-        m_profile = profile;
-        emit profileChanged(profile);
-        profile_set_profile(profile.toUtf8().constData());
-    }
+    ProfileStore::instance()->setProfile(profile);
 }
 
 int ProfileControl::ringerVolume() const
 {
-    return m_ringerVolume;
+    return ProfileStore::instance()->value(ProfileStore::RingerVolume).toInt();
 }
 
 void ProfileControl::setRingerVolume(int volume)
 {
-    if (volume == m_ringerVolume) {
-        return;
-    }
-
-    m_ringerVolume = volume;
-    profile_set_value_as_int(GeneralProfile, VolumeKey, volume);
-    emit ringerVolumeChanged();
+    ProfileStore::instance()->setValue(ProfileStore::RingerVolume, volume);
 }
 
 int ProfileControl::vibraMode() const
 {
     VibraMode result;
 
-    if (m_vibraInGeneral) {
-        if (m_vibraInSilent) {
+    const bool vibraInGeneral = ProfileStore::instance()->value(ProfileStore::VibraInGeneral).toBool();
+    const bool vibraInSilent = ProfileStore::instance()->value(ProfileStore::VibraInSilent).toBool();
+
+    if (vibraInGeneral) {
+        if (vibraInSilent) {
             result = VibraAlways;
         } else {
             result = VibraNormal;
         }
     } else {
-        if (m_vibraInSilent) {
+        if (vibraInSilent) {
             result = VibraSilent;
         } else {
             result = VibraNever;
@@ -182,488 +137,177 @@ void ProfileControl::setVibraMode(int mode)
         break;
     }
 
-    bool changed = false;
-    if (generalValue != m_vibraInGeneral) {
-        m_vibraInGeneral = generalValue;
-        profile_set_value_as_bool(GeneralProfile, VibraKey, m_vibraInGeneral);
-        changed = true;
-    }
-    if (silentValue != m_vibraInSilent) {
-        m_vibraInSilent = silentValue;
-        profile_set_value_as_bool(SilentProfile, VibraKey, m_vibraInSilent);
-        changed = true;
-    }
-
-    if (changed) {
-        emit vibraModeChanged();
-    }
+    ProfileStore::instance()->setValue(ProfileStore::VibraInGeneral, generalValue);
+    ProfileStore::instance()->setValue(ProfileStore::VibraInSilent, silentValue);
 }
 
 int ProfileControl::systemSoundLevel()
 {
-    if (m_systemSoundLevel == -1) {
-        m_systemSoundLevel = profile_get_value_as_int(GeneralProfile, SystemSoundLevelKey);
-    }
-    return m_systemSoundLevel;
+    return ProfileStore::instance()->value(ProfileStore::SystemSoundLevel).toInt();
 }
 
 void ProfileControl::setSystemSoundLevel(int level)
 {
-    if (level == m_systemSoundLevel) {
-        return;
-    }
-    m_systemSoundLevel = level;
-    profile_set_value_as_int(GeneralProfile, SystemSoundLevelKey, level);
-    emit systemSoundLevelChanged();
+    ProfileStore::instance()->setValue(ProfileStore::SystemSoundLevel, level);
 }
 
 int ProfileControl::touchscreenToneLevel()
 {
-    if (m_touchscreenToneLevel == -1) {
-        m_touchscreenToneLevel = profile_get_value_as_int(GeneralProfile, TouchscreenToneLevelKey);
-    }
-    return m_touchscreenToneLevel;
+    return ProfileStore::instance()->value(ProfileStore::TouchscreenToneLevel).toInt();
 }
 
 void ProfileControl::setTouchscreenToneLevel(int level)
 {
-    if (level == m_touchscreenToneLevel) {
-        return;
-    }
-    m_touchscreenToneLevel = level;
-    profile_set_value_as_int(GeneralProfile, TouchscreenToneLevelKey, level);
-    emit touchscreenToneLevelChanged();
+    ProfileStore::instance()->setValue(ProfileStore::TouchscreenToneLevel, level);
 }
 
 int ProfileControl::touchscreenVibrationLevel()
 {
-    if (m_touchscreenVibrationLevel == -1) {
-        m_touchscreenVibrationLevel = profile_get_value_as_int(GeneralProfile, TouchscreenVibrationLevelKey);
-    }
-    return m_touchscreenVibrationLevel;
+    return ProfileStore::instance()->value(ProfileStore::TouchscreenVibrationLevel).toInt();
 }
 
 void ProfileControl::setTouchscreenVibrationLevel(int level)
 {
-    if (level == m_touchscreenVibrationLevel) {
-        return;
-    }
-    m_touchscreenVibrationLevel = level;
-    profile_set_value_as_int(GeneralProfile, TouchscreenVibrationLevelKey, level);
-    emit touchscreenVibrationLevelChanged();
+    ProfileStore::instance()->setValue(ProfileStore::TouchscreenVibrationLevel, level);
 }
 
 QString ProfileControl::ringerToneFile()
 {
-    if (m_ringerToneFile.isNull()) {
-        m_ringerToneFile = QString::fromUtf8(profile_get_value(GeneralProfile, RingerToneKey));
-    }
-
-    return m_ringerToneFile;
+    return ProfileStore::instance()->value(ProfileStore::RingerToneFile).toString();
 }
 
 void ProfileControl::setRingerToneFile(const QString &filename)
 {
-    if (filename == m_ringerToneFile) {
-        return;
-    }
-
-    m_ringerToneFile = filename;
-    profile_set_value(GeneralProfile, RingerToneKey, filename.toUtf8().constData());
-    emit ringerToneFileChanged();
+    ProfileStore::instance()->setValue(ProfileStore::RingerToneFile, filename);
 }
 
 QString ProfileControl::messageToneFile()
 {
-    if (m_messageToneFile.isNull()) {
-        m_messageToneFile = QString::fromUtf8(profile_get_value(GeneralProfile, MessageToneKey));
-    }
-
-    return m_messageToneFile;
+    return ProfileStore::instance()->value(ProfileStore::MessageToneFile).toString();
 }
 
 void ProfileControl::setMessageToneFile(const QString &filename)
 {
-    if (filename == m_messageToneFile) {
-        return;
-    }
-
-    m_messageToneFile = filename;
-    profile_set_value(GeneralProfile, MessageToneKey, filename.toUtf8().constData());
-    emit messageToneFileChanged();
+    ProfileStore::instance()->setValue(ProfileStore::MessageToneFile, filename);
 }
 
 QString ProfileControl::chatToneFile()
 {
-    if (m_chatToneFile.isNull()) {
-        m_chatToneFile = QString::fromUtf8(profile_get_value(GeneralProfile, ChatToneKey));
-    }
-
-    return m_chatToneFile;
+    return ProfileStore::instance()->value(ProfileStore::ChatToneFile).toString();
 }
 
 void ProfileControl::setChatToneFile(const QString &filename)
 {
-    if (filename == m_chatToneFile) {
-        return;
-    }
-
-    m_chatToneFile = filename;
-    profile_set_value(GeneralProfile, ChatToneKey, filename.toUtf8().constData());
-    emit chatToneFileChanged();
+    ProfileStore::instance()->setValue(ProfileStore::ChatToneFile, filename);
 }
 
 QString ProfileControl::mailToneFile()
 {
-    if (m_mailToneFile.isNull()) {
-        m_mailToneFile = QString::fromUtf8(profile_get_value(GeneralProfile, MailToneKey));
-    }
-
-    return m_mailToneFile;
+    return ProfileStore::instance()->value(ProfileStore::MailToneFile).toString();
 }
 
 void ProfileControl::setMailToneFile(const QString &filename)
 {
-    if (filename == m_mailToneFile) {
-        return;
-    }
-
-    m_mailToneFile = filename;
-    profile_set_value(GeneralProfile, MailToneKey, filename.toUtf8().constData());
-    emit mailToneFileChanged();
+    ProfileStore::instance()->setValue(ProfileStore::MailToneFile, filename);
 }
 
 QString ProfileControl::calendarToneFile()
 {
-    if (m_calendarToneFile.isNull()) {
-        m_calendarToneFile = QString::fromUtf8(profile_get_value(GeneralProfile, CalendarToneKey));
-    }
-
-    return m_calendarToneFile;
+    return ProfileStore::instance()->value(ProfileStore::CalendarToneFile).toString();
 }
 
 void ProfileControl::setCalendarToneFile(const QString &filename)
 {
-    if (filename == m_calendarToneFile) {
-        return;
-    }
-
-    m_calendarToneFile = filename;
-    profile_set_value(GeneralProfile, CalendarToneKey, filename.toUtf8().constData());
-    emit calendarToneFileChanged();
+    ProfileStore::instance()->setValue(ProfileStore::CalendarToneFile, filename);
 }
 
 QString ProfileControl::internetCallToneFile()
 {
-    if (m_internetCallToneFile.isNull()) {
-        m_internetCallToneFile = QString::fromUtf8(profile_get_value(GeneralProfile, InternetCallToneKey));
-    }
-
-    return m_internetCallToneFile;
+    return ProfileStore::instance()->value(ProfileStore::InternetCallToneFile).toString();
 }
 
 void ProfileControl::setInternetCallToneFile(const QString &filename)
 {
-    if (filename == m_internetCallToneFile) {
-        return;
-    }
-
-    m_internetCallToneFile = filename;
-    profile_set_value(GeneralProfile, InternetCallToneKey, filename.toUtf8().constData());
-    emit internetCallToneFileChanged();
+    ProfileStore::instance()->setValue(ProfileStore::InternetCallToneFile, filename);
 }
 
 QString ProfileControl::clockAlarmToneFile()
 {
-    if (m_clockAlarmToneFile.isNull()) {
-        m_clockAlarmToneFile = QString::fromUtf8(profile_get_value(GeneralProfile, ClockAlarmToneKey));
-    }
-
-    return m_clockAlarmToneFile;
+    return ProfileStore::instance()->value(ProfileStore::ClockAlarmToneFile).toString();
 }
 
 void ProfileControl::setClockAlarmToneFile(const QString &filename)
 {
-    if (filename == m_clockAlarmToneFile) {
-        return;
-    }
-
-    m_clockAlarmToneFile = filename;
-    profile_set_value(GeneralProfile, ClockAlarmToneKey, filename.toUtf8().constData());
-    emit clockAlarmToneFileChanged();
+    ProfileStore::instance()->setValue(ProfileStore::ClockAlarmToneFile, filename);
 }
 
 
 bool ProfileControl::ringerToneEnabled()
 {
-    if (m_ringerToneEnabled == -1) {
-        m_ringerToneEnabled = profile_get_value_as_bool(GeneralProfile, RingerToneEnabledKey);
-    }
-    return m_ringerToneEnabled;
+    return ProfileStore::instance()->value(ProfileStore::RingerToneEnabled).toBool();
 }
 
 void ProfileControl::setRingerToneEnabled(bool enabled)
 {
-    if (static_cast<int>(enabled) == m_ringerToneEnabled) {
-        return;
-    }
-    m_ringerToneEnabled = enabled;
-    profile_set_value_as_bool(GeneralProfile, RingerToneEnabledKey, enabled);
-    emit ringerToneEnabledChanged();
+    ProfileStore::instance()->setValue(ProfileStore::RingerToneEnabled, enabled);
 }
 
 bool ProfileControl::messageToneEnabled()
 {
-    if (m_messageToneEnabled == -1) {
-        m_messageToneEnabled = profile_get_value_as_bool(GeneralProfile, MessageToneEnabledKey);
-    }
-    return m_messageToneEnabled;
+    return ProfileStore::instance()->value(ProfileStore::MessageToneEnabled).toBool();
 }
 
 void ProfileControl::setMessageToneEnabled(bool enabled)
 {
-    if (static_cast<int>(enabled) == m_messageToneEnabled) {
-        return;
-    }
-    m_messageToneEnabled = enabled;
-    profile_set_value_as_bool(GeneralProfile, MessageToneEnabledKey, enabled);
-    emit messageToneEnabledChanged();
+    ProfileStore::instance()->setValue(ProfileStore::MessageToneEnabled, enabled);
 }
 
 bool ProfileControl::chatToneEnabled()
 {
-    if (m_chatToneEnabled == -1) {
-        m_chatToneEnabled = profile_get_value_as_bool(GeneralProfile, ChatToneEnabledKey);
-    }
-    return m_chatToneEnabled;
+    return ProfileStore::instance()->value(ProfileStore::ChatToneEnabled).toBool();
 }
 
 void ProfileControl::setChatToneEnabled(bool enabled)
 {
-    if (static_cast<int>(enabled) == m_chatToneEnabled) {
-        return;
-    }
-    m_chatToneEnabled = enabled;
-    profile_set_value_as_bool(GeneralProfile, ChatToneEnabledKey, enabled);
-    emit chatToneEnabledChanged();
+    ProfileStore::instance()->setValue(ProfileStore::ChatToneEnabled, enabled);
 }
 
 bool ProfileControl::mailToneEnabled()
 {
-    if (m_mailToneEnabled == -1) {
-        m_mailToneEnabled = profile_get_value_as_bool(GeneralProfile, MailToneEnabledKey);
-    }
-    return m_mailToneEnabled;
+    return ProfileStore::instance()->value(ProfileStore::MailToneEnabled).toBool();
 }
 
 void ProfileControl::setMailToneEnabled(bool enabled)
 {
-    if (static_cast<int>(enabled) == m_mailToneEnabled) {
-        return;
-    }
-    m_mailToneEnabled = enabled;
-    profile_set_value_as_bool(GeneralProfile, MailToneEnabledKey, enabled);
-    emit mailToneEnabledChanged();
+    ProfileStore::instance()->setValue(ProfileStore::MailToneEnabled, enabled);
 }
 
 bool ProfileControl::internetCallToneEnabled()
 {
-    if (m_internetCallToneEnabled == -1) {
-        m_internetCallToneEnabled = profile_get_value_as_bool(GeneralProfile, InternetCallToneEnabledKey);
-    }
-    return m_internetCallToneEnabled;
+    return ProfileStore::instance()->value(ProfileStore::InternetCallToneEnabled).toBool();
 }
 
 void ProfileControl::setInternetCallToneEnabled(bool enabled)
 {
-    if (static_cast<int>(enabled) == m_internetCallToneEnabled) {
-        return;
-    }
-    m_internetCallToneEnabled = enabled;
-    profile_set_value_as_bool(GeneralProfile, InternetCallToneEnabledKey, enabled);
-    emit internetCallToneEnabledChanged();
+    ProfileStore::instance()->setValue(ProfileStore::InternetCallToneEnabled, enabled);
 }
 
 bool ProfileControl::calendarToneEnabled()
 {
-    if (m_calendarToneEnabled == -1) {
-        m_calendarToneEnabled = profile_get_value_as_bool(GeneralProfile, CalendarToneEnabledKey);
-    }
-    return m_calendarToneEnabled;
+    return ProfileStore::instance()->value(ProfileStore::CalendarToneEnabled).toBool();
 }
 
 void ProfileControl::setCalendarToneEnabled(bool enabled)
 {
-    if (static_cast<int>(enabled) == m_calendarToneEnabled) {
-        return;
-    }
-    m_calendarToneEnabled = enabled;
-    profile_set_value_as_bool(GeneralProfile, CalendarToneEnabledKey, enabled);
-    emit calendarToneEnabledChanged();
+    ProfileStore::instance()->setValue(ProfileStore::CalendarToneEnabled, enabled);
 }
 
 bool ProfileControl::clockAlarmToneEnabled()
 {
-    if (m_clockAlarmToneEnabled == -1) {
-        m_clockAlarmToneEnabled = profile_get_value_as_bool(GeneralProfile, ClockAlarmToneEnabledKey);
-    }
-    return m_clockAlarmToneEnabled;
+    return ProfileStore::instance()->value(ProfileStore::ClockAlarmToneEnabled).toBool();
 }
 
 void ProfileControl::setClockAlarmToneEnabled(bool enabled)
 {
-    if (static_cast<int>(enabled) == m_clockAlarmToneEnabled) {
-        return;
-    }
-    m_clockAlarmToneEnabled = enabled;
-    profile_set_value_as_bool(GeneralProfile, ClockAlarmToneEnabledKey, enabled);
-    emit clockAlarmToneEnabledChanged();
-}
-
-
-void ProfileControl::currentProfileChangedCallback(const char *name, ProfileControl *profileControl)
-{
-    QString newProfile = QString::fromUtf8(name);
-    if (profileControl->m_profile != newProfile) {
-        profileControl->m_profile = newProfile;
-        emit profileControl->profileChanged(newProfile);
-    }
-}
-
-void ProfileControl::updateStateCallBack(const char *profile, const char *key, const char *val, const char *type)
-{
-    Q_UNUSED(type)
-
-    if (qstrcmp(profile, GeneralProfile) == 0) {
-        if (qstrcmp(key, VolumeKey) == 0) {
-            int newVolume = QString(val).toInt();
-            if (newVolume != m_ringerVolume) {
-                m_ringerVolume = newVolume;
-                emit ringerVolumeChanged();
-            }
-        } else if (qstrcmp(key, VibraKey) == 0) {
-            bool newVibra = (qstrcmp(val, "On") == 0);
-            if (newVibra != m_vibraInGeneral) {
-                m_vibraInGeneral = newVibra;
-
-                emit vibraModeChanged();
-            }
-        } else if (qstrcmp(key, SystemSoundLevelKey) == 0) {
-            int newLevel = QString(val).toInt();
-            if (newLevel != m_systemSoundLevel) {
-                m_systemSoundLevel = newLevel;
-                emit systemSoundLevelChanged();
-            }
-        } else if (qstrcmp(key, TouchscreenToneLevelKey) == 0) {
-            int newLevel = QString(val).toInt();
-            if (newLevel != m_touchscreenToneLevel) {
-                m_touchscreenToneLevel = newLevel;
-                emit touchscreenToneLevelChanged();
-            }
-        } else if (qstrcmp(key, TouchscreenVibrationLevelKey) == 0) {
-            int newLevel = QString(val).toInt();
-            if (newLevel != m_touchscreenVibrationLevel) {
-                m_touchscreenVibrationLevel = newLevel;
-                emit touchscreenVibrationLevelChanged();
-            }
-
-            // alarm files begin
-        } else if (qstrcmp(key, RingerToneKey) == 0) {
-            QString newFile = val;
-            if (newFile != m_ringerToneFile) {
-                m_ringerToneFile = newFile;
-                emit ringerToneFileChanged();
-            }
-        } else if (qstrcmp(key, MessageToneKey) == 0) {
-            QString newFile = val;
-            if (newFile != m_messageToneFile) {
-                m_messageToneFile = newFile;
-                emit messageToneFileChanged();
-            }
-        } else if (qstrcmp(key, MailToneKey) == 0) {
-            QString newFile = val;
-            if (newFile != m_mailToneFile) {
-                m_mailToneFile = newFile;
-                emit mailToneFileChanged();
-            }
-        } else if (qstrcmp(key, InternetCallToneKey) == 0) {
-            QString newFile = val;
-            if (newFile != m_internetCallToneFile) {
-                m_internetCallToneFile = newFile;
-                emit internetCallToneFileChanged();
-            }
-        } else if (qstrcmp(key, CalendarToneKey) == 0) {
-            QString newFile = val;
-            if (newFile != m_calendarToneFile) {
-                m_calendarToneFile = newFile;
-                emit calendarToneFileChanged();
-            }
-        } else if (qstrcmp(key, ClockAlarmToneKey) == 0) {
-            QString newFile = val;
-            if (newFile != m_clockAlarmToneFile) {
-                m_clockAlarmToneFile = newFile;
-                emit clockAlarmToneFileChanged();
-            }
-
-            // alarms enabled begin
-        } else if (qstrcmp(key, RingerToneEnabledKey) == 0) {
-            int newEnabled = profile_parse_bool(val);
-            if (newEnabled != m_ringerToneEnabled) {
-                m_ringerToneEnabled = newEnabled;
-                emit ringerToneEnabledChanged();
-            }
-        } else if (qstrcmp(key, MessageToneEnabledKey) == 0) {
-            int newEnabled = profile_parse_bool(val);
-            if (newEnabled != m_messageToneEnabled) {
-                m_messageToneEnabled = newEnabled;
-                emit messageToneEnabledChanged();
-            }
-        } else if (qstrcmp(key, ChatToneEnabledKey) == 0) {
-            int newEnabled = profile_parse_bool(val);
-            if (newEnabled != m_chatToneEnabled) {
-                m_chatToneEnabled = newEnabled;
-                emit chatToneEnabledChanged();
-            }
-        } else if (qstrcmp(key, MailToneEnabledKey) == 0) {
-            int newEnabled = profile_parse_bool(val);
-            if (newEnabled != m_mailToneEnabled) {
-                m_mailToneEnabled = newEnabled;
-                emit mailToneEnabledChanged();
-            }
-        } else if (qstrcmp(key, InternetCallToneEnabledKey) == 0) {
-            int newEnabled = profile_parse_bool(val);
-            if (newEnabled != m_internetCallToneEnabled) {
-                m_internetCallToneEnabled = newEnabled;
-                emit internetCallToneEnabledChanged();
-            }
-        } else if (qstrcmp(key, CalendarToneEnabledKey) == 0) {
-            int newEnabled = profile_parse_bool(val);
-            if (newEnabled != m_calendarToneEnabled) {
-                m_calendarToneEnabled = newEnabled;
-                emit calendarToneEnabledChanged();
-            }
-        } else if (qstrcmp(key, ClockAlarmToneEnabledKey) == 0) {
-            int newEnabled = profile_parse_bool(val);
-            if (newEnabled != m_clockAlarmToneEnabled) {
-                m_clockAlarmToneEnabled = newEnabled;
-                emit clockAlarmToneEnabledChanged();
-            }
-        }
-
-    } else if (qstrcmp(profile, SilentProfile) == 0) {
-        if (qstrcmp(key, VibraKey) == 0) {
-            bool newVibra = (qstrcmp(val, "On") == 0);
-            if (newVibra != m_vibraInSilent) {
-                m_vibraInGeneral = newVibra;
-
-                emit vibraModeChanged();
-            }
-        }
-    }
-}
-
-void ProfileControl::updateStateCallBackTrampoline(const char *profile, const char *key, const char *val,
-                                                   const char *type, ProfileControl *profileControl)
-{
-    profileControl->updateStateCallBack(profile, key, val, type);
+    ProfileStore::instance()->setValue(ProfileStore::ClockAlarmToneEnabled, enabled);
 }
@@ -74,17 +74,14 @@ public:
     };
 
     /*!
-     * Register the callback functions with libprofile and
-     * activate profile change tracking.
+     * Connects to the profile values shared within the process. They
+     * are fetched asynchronously on first use and reported through the
+     * change signals.
      *
      * \param parent the parent object
      */
     ProfileControl(QObject *parent = 0);
 
-    /*!
-     * Unregisters the callback functions from libprofile and
-     * deactivates profile change tracking.
-     */
     virtual ~ProfileControl();
 
     /*!
@@ -193,39 +190,14 @@ signals:
     void calendarToneEnabledChanged();
     void clockAlarmToneEnabledChanged();
 
-private:
-    static int s_instanceCounter;
-
-    QString m_profile;
-    int m_ringerVolume;
-    bool m_vibraInGeneral;
-    bool m_vibraInSilent;
-    int m_systemSoundLevel;
-    int m_touchscreenToneLevel;
-    int m_touchscreenVibrationLevel;
-    QString m_ringerToneFile;
-    QString m_messageToneFile;
-    QString m_internetCallToneFile;
-    QString m_chatToneFile;
-    QString m_mailToneFile;
-    QString m_calendarToneFile;
-    QString m_clockAlarmToneFile;
-
-    int m_ringerToneEnabled;
-    int m_messageToneEnabled;
-    int m_chatToneEnabled;
-    int m_mailToneEnabled;
-    int m_internetCallToneEnabled;
-    int m_calendarToneEnabled;
-    int m_clockAlarmToneEnabled;
-
-    //! libprofile callback for profile changes
-    static void currentProfileChangedCallback(const char *profile, ProfileControl *profileControl);
-
-    //! libprofile callback for property changes
-    static void updateStateCallBackTrampoline(const char *profile, const char *key, const char *val, const char *type,
-                                    ProfileControl *profileControl);
-    void updateStateCallBack(const char *profile, const char *key, const char *val, const char *type);
+    /*!
+     * Signal that writing a value to profiled failed. The property
+     * keeps the value it was set to.
+     *
+     * \param profile The profile the value was written to
+     * \param key The key of the value
+     */
+    void valueWriteFailed(const QString &profile, const QString &key);
 };
 
 #endif
@@ -0,0 +1,481 @@
+/*
+ * Copyright (C) 2020 Open Mobile Platform LLC.
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+#include "profilestore_p.h"
+
+#include <libprofile.h>
+
+#include <QCoreApplication>
+#include <QDBusArgument>
+#include <QDBusConnection>
+#include <QDBusMessage>
+#include <QDBusPendingCallWatcher>
+#include <QDBusPendingReply>
+#include <QDebug>
+#include <QTimer>
+
+// NOTE: most of profiled interface blocks, values are read and written asynchronously over D-Bus instead
+
+#define PROFILED_SERVICE "com.nokia.profiled"
+#define PROFILED_PATH "/com/nokia/profiled"
+#define PROFILED_INTERFACE "com.nokia.profiled"
+#define PROFILED_GET_PROFILE "get_profile"
+#define PROFILED_GET_VALUE "get_value"
+#define PROFILED_GET_VALUES "get_values"
+#define PROFILED_SET_PROFILE "set_profile"
+#define PROFILED_SET_VALUE "set_value"
+
+namespace {
+
+// Writes to the same value within this time are sent as one
+const int WriteDelay = 100;
+
+constexpr char VolumeKey[] = "ringing.alert.volume";
+constexpr char VibraKey[] = "vibrating.alert.enabled";
+constexpr char SystemSoundLevelKey[] = "system.sound.level";
+constexpr char TouchscreenToneLevelKey[] = "touchscreen.sound.level";
+constexpr char TouchscreenVibrationLevelKey[] = "touchscreen.vibration.level";
+
+constexpr char RingerToneKey[] = "ringing.alert.tone";
+constexpr char MessageToneKey[] = "sms.alert.tone";
+constexpr char ChatToneKey[] = "im.alert.tone";
+constexpr char MailToneKey[] = "email.alert.tone";
+constexpr char InternetCallToneKey[] = "voip.alert.tone";
+constexpr char CalendarToneKey[] = "calendar.alert.tone";
+constexpr char ClockAlarmToneKey[] = "clock.alert.tone";
+
+constexpr char RingerToneEnabledKey[] = "ringing.alert.enabled";
+constexpr char MessageToneEnabledKey[] = "sms.alert.enabled";
+constexpr char ChatToneEnabledKey[] = "im.alert.enabled";
+constexpr char MailToneEnabledKey[] = "email.alert.enabled";
+constexpr char InternetCallToneEnabledKey[] = "voip.alert.enabled";
+constexpr char CalendarToneEnabledKey[] = "calendar.alert.enabled";
+constexpr char ClockAlarmToneEnabledKey[] = "clock.alert.enabled";
+
+constexpr char GeneralProfile[] = "general";
+constexpr char SilentProfile[] = "silent";
+
+enum Type {
+    None,
+    Integer,
+    Boolean,
+    String
+};
+
+/*
+ * Perfect hash of the tracked keys
+ *
+ * FNV-1a with an offset basis picked so that the keys get distinct slots.
+ * KeyHandlers is checked against this at compile time, pick another basis
+ * or table size if a new key collides.
+ */
+constexpr quint32 KeyHashBasis = 2166136297u;
+constexpr int KeyTableSize = 25;
+
+constexpr quint32 keyHash(const char *key, quint32 hash = KeyHashBasis)
+{
+    return *key ? keyHash(key + 1, (hash ^ static_cast<unsigned char>(*key)) * 16777619u) : hash;
+}
+
+constexpr int keySlot(const char *key)
+{
+    return keyHash(key) % KeyTableSize;
+}
+
+struct KeyHandler
+{
+    const char *key;
+    Type type;
+    ProfileStore::Value general;
+    ProfileStore::Value silent;  // ValueCount if not followed in the silent profile
+};
+
+// Indexed by keySlot()
+constexpr KeyHandler KeyHandlers[KeyTableSize] = {
+    { ChatToneEnabledKey, Boolean, ProfileStore::ChatToneEnabled, ProfileStore::ValueCount },
+    { nullptr, None, ProfileStore::ValueCount, ProfileStore::ValueCount },
+    { nullptr, None, ProfileStore::ValueCount, ProfileStore::ValueCount },
+    { MailToneKey, String, ProfileStore::MailToneFile, ProfileStore::ValueCount },
+    { VolumeKey, Integer, ProfileStore::RingerVolume, ProfileStore::ValueCount },
+    { TouchscreenToneLevelKey, Integer, ProfileStore::TouchscreenToneLevel, ProfileStore::ValueCount },
+    { nullptr, None, ProfileStore::ValueCount, ProfileStore::ValueCount },
+    { ClockAlarmToneEnabledKey, Boolean, ProfileStore::ClockAlarmToneEnabled, ProfileStore::ValueCount },
+    { CalendarToneEnabledKey, Boolean, ProfileStore::CalendarToneEnabled, ProfileStore::ValueCount },
+    { nullptr, None, ProfileStore::ValueCount, ProfileStore::ValueCount },
+    { TouchscreenVibrationLevelKey, Integer, ProfileStore::TouchscreenVibrationLevel, ProfileStore::ValueCount },
+    { SystemSoundLevelKey, Integer, ProfileStore::SystemSoundLevel, ProfileStore::ValueCount },
+    { ClockAlarmToneKey, String, ProfileStore::ClockAlarmToneFile, ProfileStore::ValueCount },
+    { nullptr, None, ProfileStore::ValueCount, ProfileStore::ValueCount },
+    { InternetCallToneEnabledKey, Boolean, ProfileStore::InternetCallToneEnabled, ProfileStore::ValueCount },
+    { ChatToneKey, String, ProfileStore::ChatToneFile, ProfileStore::ValueCount },
+    { RingerToneEnabledKey, Boolean, ProfileStore::RingerToneEnabled, ProfileStore::ValueCount },
+    { MessageToneKey, String, ProfileStore::MessageToneFile, ProfileStore::ValueCount },
+    { InternetCallToneKey, String, ProfileStore::InternetCallToneFile, ProfileStore::ValueCount },
+    { CalendarToneKey, String, ProfileStore::CalendarToneFile, ProfileStore::ValueCount },
+    { MailToneEnabledKey, Boolean, ProfileStore::MailToneEnabled, ProfileStore::ValueCount },
+    { MessageToneEnabledKey, Boolean, ProfileStore::MessageToneEnabled, ProfileStore::ValueCount },
+    { VibraKey, Boolean, ProfileStore::VibraInGeneral, ProfileStore::VibraInSilent },
+    { nullptr, None, ProfileStore::ValueCount, ProfileStore::ValueCount },
+    { RingerToneKey, String, ProfileStore::RingerToneFile, ProfileStore::ValueCount },
+};
+
+constexpr bool slotsMatch(int slot = 0)
+{
+    return slot == KeyTableSize
+            || ((!KeyHandlers[slot].key || keySlot(KeyHandlers[slot].key) == slot) && slotsMatch(slot + 1));
+}
+
+static_assert(slotsMatch(), "Profile key table does not match the key hash");
+
+struct ValueKey
+{
+    const char *profile;
+    const char *key;
+    Type type;
+};
+
+// Indexed by ProfileStore::Value
+const ValueKey ValueKeys[] = {
+    { GeneralProfile, VolumeKey, Integer },
+    { GeneralProfile, VibraKey, Boolean },
+    { SilentProfile, VibraKey, Boolean },
+    { GeneralProfile, SystemSoundLevelKey, Integer },
+    { GeneralProfile, TouchscreenToneLevelKey, Integer },
+    { GeneralProfile, TouchscreenVibrationLevelKey, Integer },
+    { GeneralProfile, RingerToneKey, String },
+    { GeneralProfile, MessageToneKey, String },
+    { GeneralProfile, ChatToneKey, String },
+    { GeneralProfile, MailToneKey, String },
+    { GeneralProfile, InternetCallToneKey, String },
+    { GeneralProfile, CalendarToneKey, String },
+    { GeneralProfile, ClockAlarmToneKey, String },
+    { GeneralProfile, RingerToneEnabledKey, Boolean },
+    { GeneralProfile, MessageToneEnabledKey, Boolean },
+    { GeneralProfile, ChatToneEnabledKey, Boolean },
+    { GeneralProfile, MailToneEnabledKey, Boolean },
+    { GeneralProfile, InternetCallToneEnabledKey, Boolean },
+    { GeneralProfile, CalendarToneEnabledKey, Boolean },
+    { GeneralProfile, ClockAlarmToneEnabledKey, Boolean },
+};
+
+static_assert(sizeof(ValueKeys) / sizeof(ValueKeys[0]) == ProfileStore::ValueCount,
+              "Profile value table does not match the values");
+
+QString encode(Type type, const QVariant &value)
+{
+    switch (type) {
+    case Integer:
+        return QString::number(value.toInt());
+    case Boolean:
+        // Same as profile_set_value_as_bool()
+        return value.toBool() ? QStringLiteral("On") : QStringLiteral("Off");
+    default:
+        return value.toString();
+    }
+}
+
+QVariant decode(Type type, const char *val)
+{
+    switch (type) {
+    case Integer:
+        return QString::fromUtf8(val).toInt();
+    case Boolean:
+        return profile_parse_bool(val) != 0;
+    default:
+        return QString::fromUtf8(val);
+    }
+}
+
+}
+
+ProfileStore *ProfileStore::sharedInstance = nullptr;
+
+ProfileStore *ProfileStore::instance()
+{
+    return sharedInstance ? sharedInstance : new ProfileStore;
+}
+
+ProfileStore::ProfileStore()
+    : QObject(QCoreApplication::instance())
+    , m_writeTimer(new QTimer(this))
+{
+    Q_ASSERT(!sharedInstance);
+    sharedInstance = this;
+
+    for (int &writes : m_writesInFlight) {
+        writes = 0;
+    }
+
+    m_writeTimer->setSingleShot(true);
+    m_writeTimer->setInterval(WriteDelay);
+    connect(m_writeTimer, &QTimer::timeout, this, &ProfileStore::flushWrites);
+
+    profile_track_add_profile_cb((profile_track_profile_fn_data) currentProfileChangedCallback, this, NULL);
+
+    // track changes in active and inactive profile(s)
+    profile_track_add_active_cb((profile_track_value_fn_data) &valueChangedCallback, this, NULL);
+    profile_track_add_change_cb((profile_track_value_fn_data) &valueChangedCallback, this, NULL);
+
+    profile_connection_enable_autoconnect();
+    profile_tracker_init();
+
+    // Snapshot of everything tracked, changes after it arrive through the callbacks
+    fetchProfile();
+    fetchValues(GeneralProfile);
+    fetchValues(SilentProfile);
+}
+
+ProfileStore::~ProfileStore()
+{
+    flushWrites();
+
+    profile_tracker_quit();
+    profile_track_remove_profile_cb((profile_track_profile_fn_data) currentProfileChangedCallback, this);
+    profile_track_remove_active_cb((profile_track_value_fn_data) &valueChangedCallback, this);
+    profile_track_remove_change_cb((profile_track_value_fn_data) &valueChangedCallback, this);
+
+    sharedInstance = nullptr;
+}
+
+QString ProfileStore::profile() const
+{
+    return m_profile;
+}
+
+void ProfileStore::setProfile(const QString &profile)
+{
+    if (profile == m_profile) {
+        return;
+    }
+
+    m_profile = profile;
+    emit profileChanged(profile);
+
+    QDBusMessage message = QDBusMessage::createMethodCall(PROFILED_SERVICE, PROFILED_PATH, PROFILED_INTERFACE,
+                                                          PROFILED_SET_PROFILE);
+    message.setArguments(QVariantList() << profile);
+    QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(QDBusConnection::sessionBus().asyncCall(message), this);
+    connect(watcher, &QDBusPendingCallWatcher::finished, this, [profile](QDBusPendingCallWatcher *watcher) {
+        watcher->deleteLater();
+        QDBusPendingReply<bool> reply = *watcher;
+        if (reply.isError() || !reply.value()) {
+            qWarning() << "Unable to set profile" << profile << reply.error().message();
+        }
+    });
+}
+
+QVariant ProfileStore::value(Value value) const
+{
+    return m_values[value];
+}
+
+/*
+ * Changes a value and queues it to be written to profiled
+ *
+ * Only the latest value within WriteDelay is written, notifications for
+ * the value are ignored until the write has been done.
+ */
+void ProfileStore::setValue(Value value, const QVariant &newValue)
+{
+    if (m_values[value] == newValue) {
+        return;
+    }
+
+    m_values[value] = newValue;
+    m_pendingWrites.insert(value);
+    if (!m_writeTimer->isActive()) {
+        m_writeTimer->start();
+    }
+    emit valueChanged(value, newValue);
+}
+
+void ProfileStore::flushWrites()
+{
+    m_writeTimer->stop();
+
+    for (int value : m_pendingWrites) {
+        const ValueKey &valueKey = ValueKeys[value];
+        QDBusMessage message = QDBusMessage::createMethodCall(PROFILED_SERVICE, PROFILED_PATH, PROFILED_INTERFACE,
+                                                              PROFILED_SET_VALUE);
+        message.setArguments(QVariantList() << QString::fromLatin1(valueKey.profile)
+                                            << QString::fromLatin1(valueKey.key)
+                                            << encode(valueKey.type, m_values[value]));
+        m_writesInFlight[value]++;
+
+        QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(QDBusConnection::sessionBus().asyncCall(message), this);
+        connect(watcher, &QDBusPendingCallWatcher::finished, this, [this, value](QDBusPendingCallWatcher *watcher) {
+            watcher->deleteLater();
+            m_writesInFlight[value]--;
+
+            QDBusPendingReply<bool> reply = *watcher;
+            if (reply.isError() || !reply.value()) {
+                const QString profile = QString::fromLatin1(ValueKeys[value].profile);
+                const QString key = QString::fromLatin1(ValueKeys[value].key);
+                qWarning() << "Unable to set" << key << "of profile" << profile << reply.error().message();
+                // The local value was not stored, profiled has the real one
+                m_staleValues.insert(value);
+                emit valueWriteFailed(profile, key);
+            }
+
+            if (m_writesInFlight[value] == 0 && !m_pendingWrites.contains(value) && m_staleValues.remove(value)) {
+                fetchValue(static_cast<Value>(value));
+            }
+        });
+    }
+    m_pendingWrites.clear();
+}
+
+void ProfileStore::fetchProfile()
+{
+    QDBusMessage message = QDBusMessage::createMethodCall(PROFILED_SERVICE, PROFILED_PATH, PROFILED_INTERFACE,
+                                                          PROFILED_GET_PROFILE);
+    QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(QDBusConnection::sessionBus().asyncCall(message), this);
+    connect(watcher, &QDBusPendingCallWatcher::finished, this, [this](QDBusPendingCallWatcher *watcher) {
+        watcher->deleteLater();
+        QDBusPendingReply<QString> reply = *watcher;
+        if (reply.isError()) {
+            qWarning() << "Unable to get the current profile:" << reply.error().message();
+        } else if (m_profile.isEmpty()) {
+            currentProfileChangedCallback(reply.value().toUtf8().constData(), this);
+        }
+    });
+}
+
+/*
+ * Reads one value and applies it as if it had been reported changed
+ */
+void ProfileStore::fetchValue(Value value)
+{
+    const ValueKey &valueKey = ValueKeys[value];
+    QDBusMessage message = QDBusMessage::createMethodCall(PROFILED_SERVICE, PROFILED_PATH, PROFILED_INTERFACE,
+                                                          PROFILED_GET_VALUE);
+    message.setArguments(QVariantList() << QString::fromLatin1(valueKey.profile)
+                                        << QString::fromLatin1(valueKey.key));
+    QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(QDBusConnection::sessionBus().asyncCall(message), this);
+    connect(watcher, &QDBusPendingCallWatcher::finished, this, [this, valueKey](QDBusPendingCallWatcher *watcher) {
+        watcher->deleteLater();
+        QDBusPendingReply<QString> reply = *watcher;
+        if (reply.isError()) {
+            qWarning() << "Unable to get" << valueKey.key << "of profile" << valueKey.profile << reply.error().message();
+            return;
+        }
+        updateValue(valueKey.profile, valueKey.key, reply.value().toUtf8().constData());
+    });
+}
+
+/*
+ * Reads all values of a profile in one call and applies them as if they
+ * had been reported changed
+ */
+void ProfileStore::fetchValues(const char *profile)
+{
+    QDBusMessage message = QDBusMessage::createMethodCall(PROFILED_SERVICE, PROFILED_PATH, PROFILED_INTERFACE,
+                                                          PROFILED_GET_VALUES);
+    message.setArguments(QVariantList() << QString::fromLatin1(profile));
+    QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(QDBusConnection::sessionBus().asyncCall(message), this);
+    connect(watcher, &QDBusPendingCallWatcher::finished, this, [this, profile](QDBusPendingCallWatcher *watcher) {
+        watcher->deleteLater();
+        QDBusMessage reply = watcher->reply();
+        if (reply.type() != QDBusMessage::ReplyMessage || reply.arguments().isEmpty()) {
+            qWarning() << "Unable to get values of profile" << profile << reply.errorMessage();
+            return;
+        }
+
+        // a(sss): key, value, type
+        const QDBusArgument values = reply.arguments().first().value<QDBusArgument>();
+        values.beginArray();
+        while (!values.atEnd()) {
+            QString key;
+            QString value;
+            QString type;
+            values.beginStructure();
+            values >> key >> value >> type;
+            values.endStructure();
+            updateValue(profile, key.toUtf8().constData(), value.toUtf8().constData());
+        }
+        values.endArray();
+    });
+}
+
+void ProfileStore::updateValue(const char *profile, const char *key, const char *val)
+{
+    const KeyHandler &handler = KeyHandlers[keySlot(key)];
+    if (!handler.key || qstrcmp(key, handler.key) != 0) {
+        return;
+    }
+
+    Value value;
+    if (qstrcmp(profile, GeneralProfile) == 0) {
+        value = handler.general;
+    } else if (qstrcmp(profile, SilentProfile) == 0) {
+        value = handler.silent;
+    } else {
+        return;
+    }
+
+    if (value == ValueCount) {
+        return;
+    }
+
+    const QVariant newValue = decode(handler.type, val);
+    if (m_pendingWrites.contains(value)) {
+        // The local value is newer and overwrites this one
+        return;
+    } else if (m_writesInFlight[value] > 0) {
+        // Either an echo of a write or a change from another writer racing with it,
+        // which one is stored is known only after the writes are done
+        if (m_values[value] != newValue) {
+            m_staleValues.insert(value);
+        }
+        return;
+    }
+
+    if (m_values[value] != newValue) {
+        m_values[value] = newValue;
+        emit valueChanged(value, newValue);
+    }
+}
+
+void ProfileStore::currentProfileChangedCallback(const char *profile, ProfileStore *store)
+{
+    QString newProfile = QString::fromUtf8(profile);
+    if (store->m_profile != newProfile) {
+        store->m_profile = newProfile;
+        emit store->profileChanged(newProfile);
+    }
+}
+
+void ProfileStore::valueChangedCallback(const char *profile, const char *key, const char *val, const char *type,
+                                        ProfileStore *store)
+{
+    Q_UNUSED(type)
+    store->updateValue(profile, key, val);
+}
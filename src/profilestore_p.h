@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) 2020 Open Mobile Platform LLC.
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+#ifndef PROFILESTORE_P_H
+#define PROFILESTORE_P_H
+
+#include <QObject>
+#include <QSet>
+#include <QString>
+#include <QVariant>
+
+QT_BEGIN_NAMESPACE
+class QTimer;
+QT_END_NAMESPACE
+
+/**
+ * Values of the general and silent profiles, shared by all ProfileControls
+ *
+ * There is only one libprofile tracker per process. Each change from
+ * profiled is decoded once here and handed out with valueChanged().
+ * Writes are queued, coalesced per value and sent asynchronously.
+ */
+class ProfileStore : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Value {
+        RingerVolume,
+        VibraInGeneral,
+        VibraInSilent,
+        SystemSoundLevel,
+        TouchscreenToneLevel,
+        TouchscreenVibrationLevel,
+        RingerToneFile,
+        MessageToneFile,
+        ChatToneFile,
+        MailToneFile,
+        InternetCallToneFile,
+        CalendarToneFile,
+        ClockAlarmToneFile,
+        RingerToneEnabled,
+        MessageToneEnabled,
+        ChatToneEnabled,
+        MailToneEnabled,
+        InternetCallToneEnabled,
+        CalendarToneEnabled,
+        ClockAlarmToneEnabled,
+        ValueCount
+    };
+
+    static ProfileStore *instance();
+
+    QString profile() const;
+    void setProfile(const QString &profile);
+
+    QVariant value(Value value) const;
+    void setValue(Value value, const QVariant &newValue);
+
+signals:
+    void profileChanged(const QString &profile);
+    void valueChanged(ProfileStore::Value value, const QVariant &newValue);
+    void valueWriteFailed(const QString &profile, const QString &key);
+
+private slots:
+    void flushWrites();
+
+private:
+    ProfileStore();
+    ~ProfileStore();
+
+    void fetchProfile();
+    void fetchValue(Value value);
+    void fetchValues(const char *profile);
+    void updateValue(const char *profile, const char *key, const char *val);
+
+    //! libprofile callback for profile changes
+    static void currentProfileChangedCallback(const char *profile, ProfileStore *store);
+
+    //! libprofile callback for value changes
+    static void valueChangedCallback(const char *profile, const char *key, const char *val, const char *type,
+                                     ProfileStore *store);
+
+    static ProfileStore *sharedInstance;
+
+    QString m_profile;
+    // Invalid until read from profiled or set
+    QVariant m_values[ValueCount];
+    // Values waiting to be written and writes waiting for a reply
+    QSet<int> m_pendingWrites;
+    int m_writesInFlight[ValueCount];
+    // Values to read again once their writes are done
+    QSet<int> m_staleValues;
+    QTimer *m_writeTimer;
+};
+
+#endif /* PROFILESTORE_P_H */
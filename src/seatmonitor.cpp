@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2020 Open Mobile Platform LLC.
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+#include "seatmonitor_p.h"
+#include "logging_p.h"
+
+#include <QCoreApplication>
+#include <QSocketNotifier>
+#include <poll.h>
+#include <systemd/sd-login.h>
+
+namespace {
+const auto Seat = "seat0";
+const uid_t InvalidId = (uid_t)(-1);
+}
+
+SeatMonitor *SeatMonitor::sharedInstance = nullptr;
+
+SeatMonitor *SeatMonitor::instance()
+{
+    return sharedInstance ? sharedInstance : new SeatMonitor;
+}
+
+SeatMonitor::SeatMonitor()
+    : QObject(QCoreApplication::instance())
+    , m_monitor(nullptr)
+    , m_notifier(nullptr)
+    , m_activeUid(InvalidId)
+{
+    Q_ASSERT(!sharedInstance);
+    sharedInstance = this;
+
+    // Monitor systemd-logind for changes on seats
+    if (sd_login_monitor_new("seat", &m_monitor) < 0) {
+        qCWarning(lcUsersLog) << "Could not start monitoring seat changes";
+        m_monitor = nullptr;
+    } else {
+        int fd = sd_login_monitor_get_fd(m_monitor);
+        if (fd < 0) {
+            qCWarning(lcUsersLog) << "Could not get file descriptor, not monitoring seat changes";
+            m_monitor = sd_login_monitor_unref(m_monitor);
+        } else if (!(sd_login_monitor_get_events(m_monitor) & POLLIN)) {
+            // Should not happen
+            qCWarning(lcUsersLog) << "Wrong events bits, not monitoring seat changes";
+            m_monitor = sd_login_monitor_unref(m_monitor);
+        } else {
+            m_notifier = new QSocketNotifier(fd, QSocketNotifier::Read, this);
+            connect(m_notifier, &QSocketNotifier::activated, this, &SeatMonitor::seatChanged);
+            qCDebug(lcUsersLog) << "Started monitoring seat changes";
+        }
+    }
+
+    // Read the initial state only after the monitor is in place to not miss changes
+    m_activeUid = readActiveUid();
+}
+
+SeatMonitor::~SeatMonitor()
+{
+    delete m_notifier;
+    if (m_monitor)
+        sd_login_monitor_unref(m_monitor);
+    sharedInstance = nullptr;
+}
+
+/**
+ * Returns the active user on seat0 or -1 if there is none
+ */
+uid_t SeatMonitor::activeUid() const
+{
+    return m_activeUid;
+}
+
+void SeatMonitor::seatChanged()
+{
+    if (sd_login_monitor_flush(m_monitor) < 0) {
+        qCWarning(lcUsersLog) << "Monitor flush failed, stopped monitoring seat changes";
+        m_notifier->setEnabled(false);
+    }
+
+    uid_t uid = readActiveUid();
+    if (uid != m_activeUid) {
+        uid_t previous = m_activeUid;
+        m_activeUid = uid;
+        qCDebug(lcUsersLog) << "Active user on" << Seat << "changed from" << previous << "to" << uid;
+        emit activeUidChanged(uid, previous);
+    }
+}
+
+uid_t SeatMonitor::readActiveUid()
+{
+    uid_t uid = InvalidId;
+    if (sd_seat_get_active(Seat, NULL, &uid) < 0)
+        uid = InvalidId;
+    return uid;
+}
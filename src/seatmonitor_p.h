@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2020 Open Mobile Platform LLC.
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+#ifndef SEATMONITOR_P_H
+#define SEATMONITOR_P_H
+
+#include <sys/types.h>
+
+#include <QObject>
+
+class QSocketNotifier;
+struct sd_login_monitor;
+
+/**
+ * Follows the active user on seat0
+ *
+ * There is only one systemd-logind monitor per process and it's kept
+ * running for the lifetime of the process, so that reading the active
+ * user never needs to query logind.
+ */
+class SeatMonitor : public QObject
+{
+    Q_OBJECT
+
+public:
+    static SeatMonitor *instance();
+
+    uid_t activeUid() const;
+
+signals:
+    void activeUidChanged(uint uid, uint previous);
+
+private slots:
+    void seatChanged();
+
+private:
+    SeatMonitor();
+    ~SeatMonitor();
+
+    static uid_t readActiveUid();
+
+    static SeatMonitor *sharedInstance;
+
+    sd_login_monitor *m_monitor;
+    QSocketNotifier *m_notifier;
+    uid_t m_activeUid;
+};
+
+#endif /* SEATMONITOR_P_H */
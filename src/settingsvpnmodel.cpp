@@ -30,14 +30,29 @@
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
  */
 
+#include <errno.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include <functional>
+
+#include <QFutureWatcher>
+#include <QMetaMethod>
 #include <QRegularExpression>
+#include <QSocketNotifier>
 #include <QStandardPaths>
+#include <QTimer>
+#include <QtConcurrent/QtConcurrentMap>
 #include <QDataStream>
-#include <QCryptographicHash>
+#include <QFileInfo>
 #include <QQmlEngine>
 #include <QDir>
 #include "logging_p.h"
 #include "vpnmanager.h"
+#include "vpnprovisioning_p.h"
+#include "vpnstatecounter_p.h"
+#include "vpnstatistics_p.h"
 
 #include "settingsvpnmodel.h"
 
@@ -46,19 +61,20 @@ namespace {
 const auto defaultDomain = QStringLiteral("sailfishos.org");
 const auto legacyDefaultDomain(QStringLiteral("merproject.org"));
 
-int numericValue(VpnConnection::ConnectionState state)
-{
-    return (state == VpnConnection::Ready ? 3 :
-                (state == VpnConnection::Configuration ? 2 : 0));
-}
-
-VpnConnection::ConnectionState getMaxState(VpnConnection::ConnectionState newState, VpnConnection::ConnectionState oldState)
+// Returns N for sailfishos.org.N, 0 for sailfishos.org and -1 for other domains
+int defaultDomainSuffix(const QString &domain)
 {
-    if (numericValue(newState) > numericValue(oldState)) {
-        return newState;
+    if (domain == defaultDomain)
+        return 0;
+
+    if (domain.length() > defaultDomain.length() + 1
+            && domain.startsWith(defaultDomain) && domain.at(defaultDomain.length()) == QLatin1Char('.')) {
+        bool ok = false;
+        const int suffix = domain.midRef(defaultDomain.length() + 1).toInt(&ok);
+        if (ok && suffix > 0)
+            return suffix;
     }
-
-    return oldState;
+    return -1;
 }
 
 } // end anonymous namespace
@@ -67,14 +83,29 @@ SettingsVpnModel::SettingsVpnModel(QObject* parent)
     : VpnModel(parent)
     , credentials_(QStandardPaths::writableLocation(QStandardPaths::GenericDataLocation) + QStringLiteral("/system/privileged/vpn-data"))
     , bestState_(VpnConnection::Idle)
+    , stateCounter_(new VpnStateCounter)
     , autoConnect_(false)
     , orderByConnected_(true)
     , provisioningOutputPath_(QStandardPaths::writableLocation(QStandardPaths::GenericDataLocation) + QStringLiteral("/system/privileged/vpn-provisioning"))
+    , provisioningStore_(new VpnProvisioningStore(provisioningOutputPath_))
+    , importingProvisioningFiles_(false)
+    , firstFreeDefaultDomain_(0)
+    , statisticsTimer_(new QTimer(this))
     , roles(VpnModel::roleNames())
 {
     VpnManager *manager = vpnManager();
 
     roles.insert(ConnectedRole, "connected");
+    roles.insert(RxRateRole, "rxRate");
+    roles.insert(TxRateRole, "txRate");
+    roles.insert(RxBytesRole, "rxBytes");
+    roles.insert(TxBytesRole, "txBytes");
+    roles.insert(RxHistoryRole, "rxHistory");
+    roles.insert(TxHistoryRole, "txHistory");
+    roles.insert(TimeToReadyRole, "timeToReady");
+
+    statisticsTimer_->setInterval(VpnStatistics::SampleInterval);
+    connect(statisticsTimer_, &QTimer::timeout, this, &SettingsVpnModel::sampleStatistics);
 
     connect(manager, &VpnManager::connectionAdded, this, &SettingsVpnModel::connectionAdded, Qt::UniqueConnection);
     connect(manager, &VpnManager::connectionRemoved, this, &SettingsVpnModel::connectionRemoved, Qt::UniqueConnection);
@@ -93,7 +124,10 @@ void SettingsVpnModel::createConnection(const QVariantMap &createProperties)
     QVariantMap properties(createProperties);
     const QString domain(properties.value(QString("domain")).toString());
     if (domain.isEmpty()) {
-        properties.insert(QString("domain"), QVariant::fromValue(createDefaultDomain()));
+        const DomainReservation owner = {
+            QString(), properties.value(QString("host")).toString(), properties.value(QString("name")).toString()
+        };
+        properties.insert(QString("domain"), QVariant::fromValue(createDefaultDomain(owner)));
     }
 
     vpnManager()->createConnection(properties);
@@ -107,9 +141,39 @@ QHash<int, QByteArray> SettingsVpnModel::roleNames() const
 QVariant SettingsVpnModel::data(const QModelIndex &index, int role) const
 {
     if (index.isValid() && index.row() >= 0 && index.row() < connections().count()) {
+        const VpnConnection *conn = connections().at(index.row());
         switch (role) {
         case ConnectedRole:
-            return QVariant::fromValue((bool)connections().at(index.row())->connected());
+            return QVariant::fromValue((bool)conn->connected());
+        case RxRateRole:
+        case TxRateRole:
+        case RxBytesRole:
+        case TxBytesRole:
+        case RxHistoryRole:
+        case TxHistoryRole:
+        case TimeToReadyRole: {
+            const QSharedPointer<VpnStatistics> statistics(statistics_.value(conn));
+            if (!statistics) {
+                return role == RxHistoryRole || role == TxHistoryRole ? QVariant(QVariantList())
+                                                                      : QVariant(role == TimeToReadyRole ? -1 : 0);
+            }
+            switch (role) {
+            case RxRateRole:
+                return statistics->rxRate();
+            case TxRateRole:
+                return statistics->txRate();
+            case RxBytesRole:
+                return statistics->rxBytes();
+            case TxBytesRole:
+                return statistics->txBytes();
+            case RxHistoryRole:
+                return statistics->rxHistory();
+            case TxHistoryRole:
+                return statistics->txHistory();
+            default:
+                return statistics->timeToReady();
+            }
+        }
         default:
             return VpnModel::data(index, role);
         }
@@ -155,7 +219,8 @@ void SettingsVpnModel::modifyConnection(const QString &path, const QVariantMap &
                 updatedProperties.remove("domain");
             }
             else {
-                updatedProperties.insert(QString("domain"), QVariant::fromValue(createDefaultDomain()));
+                const DomainReservation owner = { path, conn->host(), conn->name() };
+                updatedProperties.insert(QString("domain"), QVariant::fromValue(createDefaultDomain(owner)));
             }
         }
 
@@ -187,40 +252,9 @@ void SettingsVpnModel::deleteConnection(const QString &path)
             credentials_.removeCredentials(location);
         }
 
-        // Remove provisioned files
-        if (conn->type() == QStringLiteral("openvpn")) {
-            QVariantMap providerProperties = conn->providerProperties();
-            QStringList fileProperties;
-            fileProperties << QStringLiteral("OpenVPN.Cert") << QStringLiteral("OpenVPN.Key") << QStringLiteral("OpenVPN.CACert") << QStringLiteral("OpenVPN.ConfigFile");
-            for (const QString property : fileProperties) {
-                const QString filename = providerProperties.value(property).toString();
-
-                // Check if the file has been provisioned
-                if (filename.contains(provisioningOutputPath_)) {
-                    int timesUsed = 0;
-
-                    // Check the same file is not used by other connections
-                    for (VpnConnection *c : connections()) {
-                        if (filename == c->providerProperties().value(property).toString()) {
-                            timesUsed++;
-                            if (timesUsed > 1) {
-                                break;
-                            }
-                        }
-                    }
-
-                    if (timesUsed > 1) {
-                        qCInfo(lcVpnLog) << "VPN provisioning file kept, used by" << timesUsed << "connections.";
-                        continue;
-                    }
-
-                    qCInfo(lcVpnLog) << "VPN provisioning file removed: " << filename;
-                    if (!QFile::remove(filename)) {
-                        qCWarning(lcVpnLog) << "VPN provisioning file could not be removed: " << filename;
-                    }
-                }
-            }
-        }
+        // Remove provisioned files nothing else uses
+        provisioningStore_->releaseReferences(path);
+        provisioningStore_->saveIndex();
 
         vpnManager()->deleteConnection(path);
     }
@@ -257,11 +291,22 @@ bool SettingsVpnModel::compareConnections(const VpnConnection *i, const VpnConne
 {
     return ((orderByConnected_ && (i->connected() > j->connected()))
             || ((!orderByConnected_ || (i->connected() == j->connected()))
-                && (i->name().localeAwareCompare(j->name()) <= 0)));
+                && (sortKey(i).compare(sortKey(j)) <= 0)));
+}
+
+QCollatorSortKey SettingsVpnModel::sortKey(const VpnConnection *conn)
+{
+    auto it = sortKeys_.constFind(conn);
+    if (it == sortKeys_.constEnd()) {
+        it = sortKeys_.insert(conn, collator_.sortKey(conn->name()));
+    }
+    return it.value();
 }
 
 void SettingsVpnModel::orderConnections(QVector<VpnConnection*> &connections)
 {
+    // Full reorder, start with fresh keys so that stale connections don't linger
+    sortKeys_.clear();
     std::sort(connections.begin(), connections.end(), [this](const VpnConnection *i, const VpnConnection *j) -> bool {
         // Return true if i should appear before j in the list
         return compareConnections(i, j);
@@ -273,18 +318,28 @@ void SettingsVpnModel::reorderConnection(VpnConnection * conn)
     const int itemCount(connections().size());
 
     if (itemCount > 1) {
-        int index = 0;
-        for ( ; index < itemCount; ++index) {
-            const VpnConnection *existing = connections().at(index);
-            // Scenario 1 orderByConnected == true: order first by connected, second by name
-            // Scenario 2 orderByConnected == false: order only by name
-            if (!compareConnections(existing, conn)) {
-                break;
+        const int currentIndex = connections().indexOf(conn);
+        if (currentIndex < 0) {
+            return;
+        }
+
+        // The other connections are still in order, find the first one that should come
+        // after conn with a binary search over them, skipping conn itself
+        // Scenario 1 orderByConnected == true: order first by connected, second by name
+        // Scenario 2 orderByConnected == false: order only by name
+        int first = 0;
+        int last = itemCount - 1;
+        while (first < last) {
+            const int middle = first + (last - first) / 2;
+            const VpnConnection *existing = connections().at(middle < currentIndex ? middle : middle + 1);
+            if (compareConnections(existing, conn)) {
+                first = middle + 1;
+            } else {
+                last = middle;
             }
         }
-        const int currentIndex = connections().indexOf(conn);
-        if (index != currentIndex && (index - 1) != currentIndex) {
-            moveItem(currentIndex, (currentIndex < index ? (index - 1) : index));
+        if (first != currentIndex) {
+            moveItem(currentIndex, first);
         }
     }
 }
@@ -292,6 +347,7 @@ void SettingsVpnModel::reorderConnection(VpnConnection * conn)
 void SettingsVpnModel::updatedConnectionPosition()
 {
     VpnConnection *conn = qobject_cast<VpnConnection *>(sender());
+    sortKeys_.remove(conn);
     reorderConnection(conn);
 }
 
@@ -317,6 +373,19 @@ void SettingsVpnModel::connectionAdded(const QString &path)
         connect(conn, &VpnConnection::nameChanged, this, &SettingsVpnModel::updatedConnectionPosition, Qt::UniqueConnection);
         connect(conn, &VpnConnection::connectedChanged, this, &SettingsVpnModel::connectedChanged, Qt::UniqueConnection);
         connect(conn, &VpnConnection::stateChanged, this, &SettingsVpnModel::stateChanged, Qt::UniqueConnection);
+        connect(conn, &VpnConnection::domainChanged, this, &SettingsVpnModel::domainChanged, Qt::UniqueConnection);
+        connect(conn, &VpnConnection::providerPropertiesChanged, this, &SettingsVpnModel::providerPropertiesChanged, Qt::UniqueConnection);
+        connect(conn, &VpnConnection::indexChanged, this, &SettingsVpnModel::indexChanged, Qt::UniqueConnection);
+
+        if (!trackDomain(conn)) {
+            releaseDomainReservation(conn, true);
+        }
+        setBestState(stateCounter_->update(conn, conn->state()));
+        if (conn->state() == VpnConnection::Ready) {
+            updateStatistics(conn);
+        }
+        referenceProvisionedFiles(conn);
+        provisioningStore_->saveIndex();
     }
 }
 
@@ -325,6 +394,11 @@ void SettingsVpnModel::connectionRemoved(const QString &path)
     qCDebug(lcVpnLog) << "VPN connection removed";
     if (VpnConnection *conn = vpnManager()->connection(path)) {
         disconnect(conn, 0, this, 0);
+        sortKeys_.remove(conn);
+        untrackDomain(conn);
+        statistics_.remove(conn);
+        updateStatisticsSampling();
+        setBestState(stateCounter_->remove(conn));
     }
 }
 
@@ -333,17 +407,40 @@ void SettingsVpnModel::connectionsRefreshed()
     qCDebug(lcVpnLog) << "VPN connections refreshed";
     QVector<VpnConnection*> connections = vpnManager()->connections();
 
+    resetDomains();
+    QSet<QString> paths;
+
     // Check to see if the best state has changed
-    VpnConnection::ConnectionState maxState = VpnConnection::Idle;
+    stateCounter_->clear();
     for (VpnConnection *conn : connections) {
         connect(conn, &VpnConnection::nameChanged, this, &SettingsVpnModel::updatedConnectionPosition, Qt::UniqueConnection);
         connect(conn, &VpnConnection::connectedChanged, this, &SettingsVpnModel::connectedChanged, Qt::UniqueConnection);
         connect(conn, &VpnConnection::stateChanged, this, &SettingsVpnModel::stateChanged, Qt::UniqueConnection);
+        connect(conn, &VpnConnection::domainChanged, this, &SettingsVpnModel::domainChanged, Qt::UniqueConnection);
+        connect(conn, &VpnConnection::providerPropertiesChanged, this, &SettingsVpnModel::providerPropertiesChanged, Qt::UniqueConnection);
+        connect(conn, &VpnConnection::indexChanged, this, &SettingsVpnModel::indexChanged, Qt::UniqueConnection);
+
+        trackDomain(conn);
+        referenceProvisionedFiles(conn);
+        paths.insert(conn->path());
+
+        stateCounter_->update(conn, conn->state());
 
-        maxState = getMaxState(conn->state(), maxState);
+        // Connections that were ready before the model was created have had no state changes
+        if (conn->state() == VpnConnection::Ready && !statistics_.contains(conn)) {
+            updateStatistics(conn);
+        }
+    }
+
+    if (!paths.isEmpty()) {
+        // Drop connections deleted while we were not around, an empty list may just mean connman-vpn is not up
+        provisioningStore_->retainUsers(paths);
+        // All connections are referenced now, the rest was stored for nothing
+        provisioningStore_->removeUnreferenced();
     }
+    provisioningStore_->saveIndex();
 
-    updateBestState(maxState);
+    setBestState(stateCounter_->bestState());
 }
 
 void SettingsVpnModel::stateChanged()
@@ -353,35 +450,208 @@ void SettingsVpnModel::stateChanged()
     emit connectionStateChanged(conn->path(), conn->state());
 
     // Check to see if the best state has changed
-    VpnConnection::ConnectionState maxState = getMaxState(conn->state(), VpnConnection::Idle);
-    updateBestState(maxState);
+    setBestState(stateCounter_->update(conn, conn->state()));
+
+    updateStatistics(conn);
+}
+
+void SettingsVpnModel::indexChanged()
+{
+    // The interface may become known only after the connection got ready
+    VpnConnection *conn = qobject_cast<VpnConnection *>(sender());
+    if (conn->state() == VpnConnection::Ready) {
+        updateStatistics(conn);
+    }
+}
+
+// ==========================================================================
+// Traffic statistics
+// ==========================================================================
+
+/*
+ * Applies the state of the connection to its traffic statistics
+ *
+ * The statistics are created once the connection starts connecting or
+ * gets ready, connections that never do so don't get any.
+ */
+void SettingsVpnModel::updateStatistics(VpnConnection *conn)
+{
+    const VpnConnection::ConnectionState state = conn->state();
+    QSharedPointer<VpnStatistics> statistics(statistics_.value(conn));
+    if (!statistics) {
+        if (state != VpnConnection::Configuration && state != VpnConnection::Ready) {
+            return;
+        }
+        statistics.reset(new VpnStatistics);
+        statistics_.insert(conn, statistics);
+    }
+    switch (state) {
+    case VpnConnection::Configuration:
+        statistics->activationStarted();
+        break;
+    case VpnConnection::Ready: {
+        statistics->ready(conn->index());
+        const int row = connections().indexOf(conn);
+        if (row >= 0) {
+            const QModelIndex index(createIndex(row, 0));
+            emit dataChanged(index, index, QVector<int>() << TimeToReadyRole);
+        }
+        break;
+    }
+    default:
+        statistics->stopped();
+        break;
+    }
+    updateStatisticsSampling();
+}
+
+void SettingsVpnModel::connectNotify(const QMetaMethod &signal)
+{
+    VpnModel::connectNotify(signal);
+    if (signal == QMetaMethod::fromSignal(&QAbstractItemModel::dataChanged)) {
+        QMetaObject::invokeMethod(this, "updateStatisticsSampling", Qt::QueuedConnection);
+    }
+}
+
+void SettingsVpnModel::disconnectNotify(const QMetaMethod &signal)
+{
+    VpnModel::disconnectNotify(signal);
+    if (signal == QMetaMethod::fromSignal(&QAbstractItemModel::dataChanged)) {
+        QMetaObject::invokeMethod(this, "updateStatisticsSampling", Qt::QueuedConnection);
+    }
+}
+
+void SettingsVpnModel::updateStatisticsSampling()
+{
+    // Views follow dataChanged, without them nobody is looking at the statistics
+    bool sample = isSignalConnected(QMetaMethod::fromSignal(&QAbstractItemModel::dataChanged));
+    if (sample) {
+        sample = false;
+        for (const QSharedPointer<VpnStatistics> &statistics : statistics_) {
+            if (statistics->isSampling()) {
+                sample = true;
+                break;
+            }
+        }
+    }
+
+    if (sample && !statisticsTimer_->isActive()) {
+        statisticsTimer_->start();
+    } else if (!sample && statisticsTimer_->isActive()) {
+        statisticsTimer_->stop();
+    }
+}
+
+void SettingsVpnModel::sampleStatistics()
+{
+    static const QVector<int> statisticsRoles = {
+        RxRateRole, TxRateRole, RxBytesRole, TxBytesRole, RxHistoryRole, TxHistoryRole
+    };
+
+    for (auto it = statistics_.constBegin(); it != statistics_.constEnd(); ++it) {
+        if (it.value()->sample()) {
+            const int row = connections().indexOf(const_cast<VpnConnection *>(it.key()));
+            if (row >= 0) {
+                const QModelIndex index(createIndex(row, 0));
+                emit dataChanged(index, index, statisticsRoles);
+            }
+        }
+    }
 }
 
 // ==========================================================================
 // Automatic domain allocation
 // ==========================================================================
 
-bool SettingsVpnModel::domainInUse(const QString &domain) const
+QString SettingsVpnModel::createDefaultDomain(const DomainReservation &owner)
 {
-    const int itemCount(count());
-    for (int index = 0; index < itemCount; ++index) {
-        const VpnConnection *connection = connections().at(index);
-        if (connection->domain() == domain) {
-            return true;
+    // Suffixes below firstFreeDefaultDomain_ are all taken, so handing out
+    // domains one after another stays linear in the number of connections
+    while (defaultDomainUsage_.contains(firstFreeDefaultDomain_)
+           || reservedDefaultDomains_.contains(firstFreeDefaultDomain_)) {
+        ++firstFreeDefaultDomain_;
+    }
+
+    const int suffix = firstFreeDefaultDomain_++;
+    // The connection is created asynchronously, keep the domain from being handed out twice
+    reservedDefaultDomains_.insert(suffix, owner);
+    return suffix == 0 ? defaultDomain : defaultDomain + QString(".%1").arg(suffix);
+}
+
+/*
+ * Releases the domains reserved for the connection, which ended up with a domain that was not reserved
+ *
+ * Connections identify themselves by host and domain, so a suffix may be
+ * handed out again only once its owner is known not to use it. Reservations
+ * for a modified connection are matched by path when its domain changes.
+ * A reservation for a new connection is matched by host and name when a
+ * connection is added, one per added connection. VpnManager does not report
+ * failed creations, the suffixes of those stay reserved for the lifetime of
+ * the model.
+ */
+void SettingsVpnModel::releaseDomainReservation(const VpnConnection *conn, bool added)
+{
+    for (auto it = reservedDefaultDomains_.begin(); it != reservedDefaultDomains_.end(); ) {
+        const DomainReservation &owner(it.value());
+        const bool owned = owner.path.isEmpty()
+                ? added && owner.host == conn->host() && owner.name == conn->name()
+                : owner.path == conn->path();
+        if (owned) {
+            if (!defaultDomainUsage_.contains(it.key()))
+                firstFreeDefaultDomain_ = qMin(firstFreeDefaultDomain_, it.key());
+            it = reservedDefaultDomains_.erase(it);
+            if (added)
+                break;
+        } else {
+            ++it;
         }
     }
-    return false;
 }
 
-QString SettingsVpnModel::createDefaultDomain() const
+/*
+ * Returns true if the domain of the connection was one of the reserved ones
+ */
+bool SettingsVpnModel::trackDomain(const VpnConnection *conn)
 {
-    QString newDomain = defaultDomain;
-    int index = 1;
-    while (domainInUse(newDomain)) {
-        newDomain = defaultDomain + QString(".%1").arg(index);
-        ++index;
+    untrackDomain(conn);
+
+    const int suffix = defaultDomainSuffix(conn->domain());
+    if (suffix < 0)
+        return false;
+
+    defaultDomainSuffixes_.insert(conn, suffix);
+    ++defaultDomainUsage_[suffix];
+    return reservedDefaultDomains_.remove(suffix) > 0;
+}
+
+void SettingsVpnModel::untrackDomain(const VpnConnection *conn)
+{
+    auto it = defaultDomainSuffixes_.find(conn);
+    if (it == defaultDomainSuffixes_.end())
+        return;
+
+    const int suffix = it.value();
+    defaultDomainSuffixes_.erase(it);
+    if (--defaultDomainUsage_[suffix] <= 0) {
+        defaultDomainUsage_.remove(suffix);
+        firstFreeDefaultDomain_ = qMin(firstFreeDefaultDomain_, suffix);
+    }
+}
+
+void SettingsVpnModel::resetDomains()
+{
+    defaultDomainUsage_.clear();
+    defaultDomainSuffixes_.clear();
+    // Reservations are kept, those connections may not have been created yet
+    firstFreeDefaultDomain_ = 0;
+}
+
+void SettingsVpnModel::domainChanged()
+{
+    VpnConnection *conn = qobject_cast<VpnConnection *>(sender());
+    if (!trackDomain(conn)) {
+        releaseDomainReservation(conn, false);
     }
-    return newDomain;
 }
 
 bool SettingsVpnModel::isDefaultDomain(const QString &domain)
@@ -478,9 +748,117 @@ QVariantMap SettingsVpnModel::connectionSettings(const QString &path)
 
 SettingsVpnModel::CredentialsRepository::CredentialsRepository(const QString &path)
     : baseDir_(path)
+    , inotifyFd_(-1)
+    , watch_(-1)
 {
     if (!baseDir_.exists() && !baseDir_.mkpath(path)) {
         qWarning() << "Unable to create base directory for VPN credentials:" << path;
+        return;
+    }
+
+    // Another process may store/remove the credentials, follow the directory
+    // so that existence checks can be answered from memory
+    inotifyFd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotifyFd_ < 0) {
+        qCWarning(lcVpnLog) << "Unable to watch VPN credentials:" << strerror(errno);
+        return;
+    }
+
+    if (!watchDirectory()) {
+        close(inotifyFd_);
+        inotifyFd_ = -1;
+        return;
+    }
+
+    notifier_.reset(new QSocketNotifier(inotifyFd_, QSocketNotifier::Read));
+    QObject::connect(notifier_.data(), &QSocketNotifier::activated, [this] {
+        readEvents();
+    });
+    rescan();
+}
+
+SettingsVpnModel::CredentialsRepository::~CredentialsRepository()
+{
+    notifier_.reset();
+    if (inotifyFd_ >= 0) {
+        close(inotifyFd_);
+    }
+}
+
+bool SettingsVpnModel::CredentialsRepository::watchDirectory()
+{
+    if (watch_ >= 0) {
+        // Fails harmlessly if the kernel dropped the watch already
+        inotify_rm_watch(inotifyFd_, watch_);
+        watch_ = -1;
+    }
+
+    const QString path(baseDir_.absolutePath());
+    if (!baseDir_.exists() && !baseDir_.mkpath(path)) {
+        qCWarning(lcVpnLog) << "Unable to create base directory for VPN credentials:" << path;
+        return false;
+    }
+
+    const uint32_t mask = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF;
+    watch_ = inotify_add_watch(inotifyFd_, QFile::encodeName(path).constData(), mask);
+    if (watch_ < 0) {
+        qCWarning(lcVpnLog) << "Unable to watch VPN credentials:" << strerror(errno);
+        return false;
+    }
+    return true;
+}
+
+void SettingsVpnModel::CredentialsRepository::readEvents()
+{
+    alignas(struct inotify_event) char buffer[4096];
+    bool overflow = false;
+    bool lost = false;
+
+    ssize_t length;
+    while ((length = read(inotifyFd_, buffer, sizeof(buffer))) > 0) {
+        for (char *ptr = buffer; ptr < buffer + length; ) {
+            const struct inotify_event *event = reinterpret_cast<const struct inotify_event *>(ptr);
+            ptr += sizeof(struct inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                overflow = true;
+            } else if (event->wd != watch_) {
+                // Left over from a watch that was replaced
+                continue;
+            } else if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) {
+                lost = true;
+            } else if (event->len > 0 && !(event->mask & IN_ISDIR)) {
+                const QString location = QFile::decodeName(event->name);
+                if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+                    locations_.insert(location);
+                } else if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+                    locations_.remove(location);
+                }
+            }
+        }
+    }
+
+    if (lost && !watchDirectory()) {
+        // The directory went away and can't be followed again, stop trusting the cache.
+        // This runs from the notifier's own signal, so it can't be deleted right away.
+        qCWarning(lcVpnLog) << "VPN credentials directory watch lost, checking the file system instead";
+        notifier_->setEnabled(false);
+        notifier_.take()->deleteLater();
+        close(inotifyFd_);
+        inotifyFd_ = -1;
+        locations_.clear();
+    } else if (lost || overflow) {
+        // Events were lost or the directory was replaced, read it again
+        rescan();
+    }
+}
+
+void SettingsVpnModel::CredentialsRepository::rescan()
+{
+    locations_.clear();
+    const QStringList entries = baseDir_.entryList(QDir::Files | QDir::Hidden | QDir::System);
+    for (const QString &entry : entries) {
+        locations_.insert(entry);
     }
 }
 
@@ -496,6 +874,11 @@ QString SettingsVpnModel::CredentialsRepository::locationForObjectPath(const QSt
 
 bool SettingsVpnModel::CredentialsRepository::credentialsExist(const QString &location) const
 {
+    if (notifier_) {
+        // Kept up to date from inotify
+        return locations_.contains(location);
+    }
+
     // Test the FS, as another process may store/remove the credentials
     return baseDir_.exists(location);
 }
@@ -510,6 +893,8 @@ bool SettingsVpnModel::CredentialsRepository::storeCredentials(const QString &lo
         credentialsFile.write(encodeCredentials(credentials));
         credentialsFile.setPermissions(QFileDevice::ReadOwner | QFileDevice::WriteOwner | QFileDevice::ReadOther | QFileDevice::WriteOther);
         credentialsFile.close();
+        // Don't wait for the inotify event to see our own changes
+        locations_.insert(location);
     }
 
     return true;
@@ -523,6 +908,7 @@ bool SettingsVpnModel::CredentialsRepository::removeCredentials(const QString &l
             return false;
         }
     }
+    locations_.remove(location);
 
     return true;
 }
@@ -601,246 +987,116 @@ QVariantMap SettingsVpnModel::CredentialsRepository::decodeCredentials(const QBy
 
 QVariantMap SettingsVpnModel::processProvisioningFile(const QString &path, const QString &type)
 {
-    QVariantMap rv;
-
-    QFile provisioningFile(path);
-    if (provisioningFile.open(QIODevice::ReadOnly)) {
-        if (type == QString("openvpn")) {
-            rv = processOpenVpnProvisioningFile(provisioningFile);
-        } else {
-            qWarning() << "Provisioning not currently supported for VPN type:" << type;
-        }
-    } else {
-        qWarning() << "Unable to open provisioning file:" << path;
-    }
-
-    return rv;
+    return VpnProvisioning::parse(path, type, provisioningStore_.data());
 }
 
-QVariantMap SettingsVpnModel::processOpenVpnProvisioningFile(QFile &provisioningFile)
+/*
+ * Creates a connection for each provisioning file of type in path
+ *
+ * Path may be a single file or a directory of them. Files are parsed in
+ * parallel off the GUI thread, provisioningImportProgress is emitted as
+ * they are done and provisioningImportFinished once the connections have
+ * been requested.
+ */
+void SettingsVpnModel::importProvisioningFiles(const QString &path, const QString &type)
 {
-    QVariantMap rv;
+    if (importingProvisioningFiles_) {
+        qCWarning(lcVpnLog) << "VPN provisioning import already in progress, ignoring:" << path;
+        return;
+    }
 
-    QString embeddedMarker;
-    QString embeddedContent;
-    QStringList extraOptions;
+    const QStringList files = VpnProvisioning::provisioningFiles(path, type);
+    if (files.isEmpty()) {
+        qCWarning(lcVpnLog) << "No VPN provisioning files found:" << path;
+        emit provisioningImportFinished(0, 0);
+        return;
+    }
 
-    const QRegularExpression commentLeader(QStringLiteral("^\\s*(?:\\#|\\;)"));
-    const QRegularExpression embeddedLeader(QStringLiteral("^\\s*<([^\\/>]+)>"));
-    const QRegularExpression embeddedTrailer(QStringLiteral("^\\s*<\\/([^\\/>]+)>"));
-    const QRegularExpression whitespace(QStringLiteral("\\s"));
+    importingProvisioningFiles_ = true;
 
-    auto normaliseProtocol = [](const QString &proto) {
-        if (proto == QStringLiteral("tcp")) {
-            // 'tcp' is an undocumented option, which is interpreted by openvpn as 'tcp-client'
-            return QStringLiteral("tcp-client");
-        }
-        return proto;
+    QSharedPointer<VpnProvisioningStore> store(provisioningStore_);
+    std::function<VpnProvisioning::Result(const QString &)> parseFile = [store, type](const QString &file) {
+        VpnProvisioning::Result result;
+        result.path = file;
+        result.type = type;
+        result.properties = VpnProvisioning::parse(file, type, store.data());
+        return result;
     };
 
-    QTextStream is(&provisioningFile);
-    while (!is.atEnd()) {
-        QString line(is.readLine());
-
-        QRegularExpressionMatch match;
-        if (line.contains(commentLeader)) {
-            // Skip
-        } else if (line.contains(embeddedLeader, &match)) {
-            embeddedMarker = match.captured(1);
-            if (embeddedMarker.isEmpty()) {
-                qWarning() << "Invalid embedded content";
-            }
-        } else if (line.contains(embeddedTrailer, &match)) {
-            const QString marker = match.captured(1);
-            if (marker != embeddedMarker) {
-                qWarning() << "Invalid embedded content:" << marker << "!=" << embeddedMarker;
-            } else {
-                if (embeddedContent.isEmpty()) {
-                    qWarning() << "Ignoring empty embedded content:" << embeddedMarker;
-                } else {
-                    if (embeddedMarker == QStringLiteral("connection")) {
-                        // Special case: not embedded content, but a <connection> structure - pass through as an extra option
-                        extraOptions.append(QStringLiteral("<connection>\n") + embeddedContent + QStringLiteral("</connection>"));
-                    } else {
-                        // Embedded content
-                        QDir outputDir(provisioningOutputPath_);
-                        if (!outputDir.exists() && !outputDir.mkpath(provisioningOutputPath_)) {
-                            qWarning() << "Unable to create base directory for VPN provisioning content:" << provisioningOutputPath_;
-                        } else {
-                            // Name the file according to content
-                            QCryptographicHash hash(QCryptographicHash::Sha1);
-                            hash.addData(embeddedContent.toUtf8());
-
-                            const QString outputFileName(QString(hash.result().toHex()) + QChar('.') + embeddedMarker);
-                            QFile outputFile(outputDir.absoluteFilePath(outputFileName));
-                            if (!outputFile.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
-                                qWarning() << "Unable to write VPN provisioning content file:" << outputFile.fileName();
-                            } else {
-                                QTextStream os(&outputFile);
-                                os << embeddedContent;
-
-                                // Add the file to the configuration
-                                if (embeddedMarker == QStringLiteral("ca")) {
-                                    rv.insert(QStringLiteral("OpenVPN.CACert"), outputFile.fileName());
-                                } else if (embeddedMarker == QStringLiteral("cert")) {
-                                    rv.insert(QStringLiteral("OpenVPN.Cert"), outputFile.fileName());
-                                } else if (embeddedMarker == QStringLiteral("key")) {
-                                    rv.insert(QStringLiteral("OpenVPN.Key"), outputFile.fileName());
-                                } else {
-                                    // Assume that the marker corresponds to the openvpn option, (such as 'tls-auth')
-                                    extraOptions.append(embeddedMarker + QChar(' ') + outputFile.fileName());
-                                }
-                            }
-                        }
-                    }
-                }
-            }
-            embeddedMarker.clear();
-            embeddedContent.clear();
-        } else if (!embeddedMarker.isEmpty()) {
-            embeddedContent.append(line + QStringLiteral("\n"));
-        } else {
-            QStringList tokens(line.split(whitespace, QString::SkipEmptyParts));
-            if (!tokens.isEmpty()) {
-                // Find directives that become part of the connman configuration
-                const QString& directive(tokens.front());
-                const QStringList arguments(tokens.count() > 1 ? tokens.mid(1) : QStringList());
-
-                if (directive == QStringLiteral("remote")) {
-                    // Connman supports a single remote host - if we get further instances, pass them through the config file
-                    if (!rv.contains(QStringLiteral("Host"))) {
-                        if (arguments.count() > 0) {
-                            rv.insert(QStringLiteral("Host"), arguments.at(0));
-                        }
-                        if (arguments.count() > 1) {
-                            rv.insert(QStringLiteral("OpenVPN.Port"), arguments.at(1));
-                        }
-                        if (arguments.count() > 2) {
-                            rv.insert(QStringLiteral("OpenVPN.Proto"), normaliseProtocol(arguments.at(2)));
-                        }
-                    } else {
-                        extraOptions.append(line);
-                    }
-                } else if (directive == QStringLiteral("ca") ||
-                           directive == QStringLiteral("cert") ||
-                           directive == QStringLiteral("key") ||
-                           directive == QStringLiteral("auth-user-pass")) {
-                    if (!arguments.isEmpty()) {
-                        // If these file paths are not absolute, assume they are in the same directory as the provisioning file
-                        QString file(arguments.at(0));
-                        if (!file.startsWith(QChar('/'))) {
-                            const QFileInfo info(provisioningFile.fileName());
-                            file = info.dir().absoluteFilePath(file);
-                        }
-                        if (directive == QStringLiteral("ca")) {
-                            rv.insert(QStringLiteral("OpenVPN.CACert"), file);
-                        } else if (directive == QStringLiteral("cert")) {
-                            rv.insert(QStringLiteral("OpenVPN.Cert"), file);
-                        } else if (directive == QStringLiteral("key")) {
-                            rv.insert(QStringLiteral("OpenVPN.Key"), file);
-                        } else if (directive == QStringLiteral("auth-user-pass")) {
-                            rv.insert(QStringLiteral("OpenVPN.AuthUserPass"), file);
-                        }
-                    } else if (directive == QStringLiteral("auth-user-pass")) {
-                        // Preserve this option to mean ask for credentials
-                        rv.insert(QStringLiteral("OpenVPN.AuthUserPass"), QStringLiteral("-"));
-                    }
-                } else if (directive == QStringLiteral("mtu") ||
-                           directive == QStringLiteral("tun-mtu")) {
-                    // Connman appears to use a long obsolete form of this option...
-                    if (!arguments.isEmpty()) {
-                        rv.insert(QStringLiteral("OpenVPN.MTU"), arguments.join(QChar(' ')));
-                    }
-                } else if (directive == QStringLiteral("ns-cert-type")) {
-                    if (!arguments.isEmpty()) {
-                        rv.insert(QStringLiteral("OpenVPN.NSCertType"), arguments.join(QChar(' ')));
-                    }
-                } else if (directive == QStringLiteral("proto")) {
-                    if (!arguments.isEmpty()) {
-                        // All values from a 'remote' directive to take precedence
-                        if (!rv.contains(QStringLiteral("OpenVPN.Proto"))) {
-                            rv.insert(QStringLiteral("OpenVPN.Proto"), normaliseProtocol(arguments.join(QChar(' '))));
-                        }
-                    }
-                } else if (directive == QStringLiteral("port")) {
-                    // All values from a 'remote' directive to take precedence
-                    if (!rv.contains(QStringLiteral("OpenVPN.Port"))) {
-                        if (!arguments.isEmpty()) {
-                            rv.insert(QStringLiteral("OpenVPN.Port"), arguments.join(QChar(' ')));
-                        }
-                    }
-                } else if (directive == QStringLiteral("askpass")) {
-                    if (!arguments.isEmpty()) {
-                        rv.insert(QStringLiteral("OpenVPN.AskPass"), arguments.join(QChar(' ')));
-                    } else {
-                        rv.insert(QStringLiteral("OpenVPN.AskPass"), QString());
-                    }
-                } else if (directive == QStringLiteral("auth-nocache")) {
-                    rv.insert(QStringLiteral("OpenVPN.AuthNoCache"), QStringLiteral("true"));
-                } else if (directive == QStringLiteral("tls-remote")) {
-                    if (!arguments.isEmpty()) {
-                        rv.insert(QStringLiteral("OpenVPN.TLSRemote"), arguments.join(QChar(' ')));
-                    }
-                } else if (directive == QStringLiteral("cipher")) {
-                    if (!arguments.isEmpty()) {
-                        rv.insert(QStringLiteral("OpenVPN.Cipher"), arguments.join(QChar(' ')));
-                    }
-                } else if (directive == QStringLiteral("auth")) {
-                    if (!arguments.isEmpty()) {
-                        rv.insert(QStringLiteral("OpenVPN.Auth"), arguments.join(QChar(' ')));
-                    }
-                } else if (directive == QStringLiteral("comp-lzo")) {
-                    if (!arguments.isEmpty()) {
-                        rv.insert(QStringLiteral("OpenVPN.CompLZO"), arguments.join(QChar(' ')));
-                    } else {
-                        rv.insert(QStringLiteral("OpenVPN.CompLZO"), QStringLiteral("adaptive"));
-                    }
-                } else if (directive == QStringLiteral("remote-cert-tls")) {
-                    if (!arguments.isEmpty()) {
-                        rv.insert(QStringLiteral("OpenVPN.RemoteCertTls"), arguments.join(QChar(' ')));
-                    }
-                } else {
-                    // A directive that connman does not care about - pass through to the config file
-                    extraOptions.append(line);
-                }
-            }
+    auto *watcher = new QFutureWatcher<VpnProvisioning::Result>(this);
+    connect(watcher, &QFutureWatcherBase::progressValueChanged, this, [this, watcher](int value) {
+        emit provisioningImportProgress(value, watcher->progressMaximum());
+    });
+    connect(watcher, &QFutureWatcherBase::finished, this, [this, watcher] {
+        createProvisionedConnections(watcher->future().results());
+        watcher->deleteLater();
+    });
+    watcher->setFuture(QtConcurrent::mapped(files, parseFile));
+}
+
+void SettingsVpnModel::referenceProvisionedFiles(const VpnConnection *conn)
+{
+    QStringList files;
+    const QVariantMap providerProperties(conn->providerProperties());
+    for (auto it = providerProperties.constBegin(); it != providerProperties.constEnd(); ++it) {
+        const QString value(it.value().toString());
+        if (provisioningStore_->contains(value)) {
+            files.append(value);
         }
     }
+    provisioningStore_->addReferences(conn->path(), files);
+}
 
-    if (!extraOptions.isEmpty()) {
-        // Write a config file to contain the extra options
-        QDir outputDir(provisioningOutputPath_);
-        if (!outputDir.exists() && !outputDir.mkpath(provisioningOutputPath_)) {
-            qWarning() << "Unable to create base directory for VPN provisioning content:" << provisioningOutputPath_;
-        } else {
-            // Name the file according to content
-            QCryptographicHash hash(QCryptographicHash::Sha1);
-            foreach (const QString &line, extraOptions) {
-                hash.addData(line.toUtf8());
-            }
-
-            const QString outputFileName(QString(hash.result().toHex()) + QStringLiteral(".conf"));
-            QFile outputFile(outputDir.absoluteFilePath(outputFileName));
-            if (!outputFile.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
-                qWarning() << "Unable to write VPN provisioning configuration file:" << outputFile.fileName();
-            } else {
-                QTextStream os(&outputFile);
-                foreach (const QString &line, extraOptions) {
-                    os << line << endl;
-                }
+void SettingsVpnModel::providerPropertiesChanged()
+{
+    VpnConnection *conn = qobject_cast<VpnConnection *>(sender());
+    referenceProvisionedFiles(conn);
+    provisioningStore_->saveIndex();
+}
 
-                rv.insert(QStringLiteral("OpenVPN.ConfigFile"), outputFile.fileName());
-            }
+void SettingsVpnModel::createProvisionedConnections(const QList<VpnProvisioning::Result> &results)
+{
+    int imported = 0;
+    int failed = 0;
+    QSet<QString> usedFiles;
+    QSet<QString> unusedFiles;
+
+    // Request all connections in one go, default domains are allocated without waiting for them
+    for (const VpnProvisioning::Result &result : results) {
+        QVariantMap providerProperties(result.properties);
+        const QString host(providerProperties.take(QStringLiteral("Host")).toString());
+        QSet<QString> &files(host.isEmpty() ? unusedFiles : usedFiles);
+        for (const QVariant &value : providerProperties) {
+            if (provisioningStore_->contains(value.toString()))
+                files.insert(value.toString());
+        }
+        if (host.isEmpty()) {
+            qCWarning(lcVpnLog) << "Ignoring VPN provisioning file without a host:" << result.path;
+            ++failed;
+            continue;
         }
+
+        QVariantMap properties;
+        properties.insert(QStringLiteral("type"), result.type);
+        properties.insert(QStringLiteral("name"), QFileInfo(result.path).completeBaseName());
+        properties.insert(QStringLiteral("host"), host);
+        properties.insert(QStringLiteral("providerProperties"), providerProperties);
+        createConnection(properties);
+        ++imported;
     }
 
-    return rv;
+    // Files of the connections that are not created would otherwise stay pending
+    provisioningStore_->discard(unusedFiles.subtract(usedFiles).toList());
+
+    qCInfo(lcVpnLog) << "VPN provisioning import finished, imported:" << imported << "failed:" << failed;
+    importingProvisioningFiles_ = false;
+    emit provisioningImportFinished(imported, failed);
 }
 
-void SettingsVpnModel::updateBestState(VpnConnection::ConnectionState maxState)
+void SettingsVpnModel::setBestState(VpnConnection::ConnectionState state)
 {
-    if (bestState_ != maxState) {
-        bestState_ = maxState;
+    if (bestState_ != state) {
+        bestState_ = state;
         emit bestStateChanged();
     }
 }
@@ -36,11 +36,22 @@
 #include <QObject>
 #include <QSet>
 #include <QDir>
+#include <QCollator>
+#include <QHash>
+#include <QScopedPointer>
+#include <QSharedPointer>
 
 #include <vpnconnection.h>
 #include <vpnmodel.h>
 #include <systemsettingsglobal.h>
 
+class QSocketNotifier;
+class QTimer;
+class VpnProvisioningStore;
+class VpnStateCounter;
+class VpnStatistics;
+namespace VpnProvisioning { struct Result; }
+
 class SYSTEMSETTINGS_EXPORT SettingsVpnModel : public VpnModel
 {
     Q_OBJECT
@@ -54,7 +65,14 @@ public:
     ~SettingsVpnModel() override;
 
     enum ItemRoles {
-        ConnectedRole = VpnModel::VpnRole + 1
+        ConnectedRole = VpnModel::VpnRole + 1,
+        RxRateRole,
+        TxRateRole,
+        RxBytesRole,
+        TxBytesRole,
+        RxHistoryRole,
+        TxHistoryRole,
+        TimeToReadyRole
     };
 
     QHash<int, QByteArray> roleNames() const override;
@@ -82,6 +100,7 @@ public:
     Q_INVOKABLE QVariantMap connectionSettings(const QString &path);
 
     Q_INVOKABLE QVariantMap processProvisioningFile(const QString &path, const QString &type);
+    Q_INVOKABLE void importProvisioningFiles(const QString &path, const QString &type);
 
     Q_INVOKABLE VpnConnection *get(int index) const;
 
@@ -90,15 +109,34 @@ signals:
     void autoConnectChanged();
     void connectionStateChanged(const QString &path, VpnConnection::ConnectionState state);
     void orderByConnectedChanged();
+    void provisioningImportProgress(int processed, int total);
+    void provisioningImportFinished(int imported, int failed);
+
+protected:
+    void connectNotify(const QMetaMethod &signal) override;
+    void disconnectNotify(const QMetaMethod &signal) override;
 
 private:
-    bool domainInUse(const QString &domain) const;
-    QString createDefaultDomain() const;
+    // Who a default domain was handed out to, path is empty for new connections
+    struct DomainReservation {
+        QString path;
+        QString host;
+        QString name;
+    };
+
+    QString createDefaultDomain(const DomainReservation &owner);
+    void releaseDomainReservation(const VpnConnection *conn, bool added);
+    bool trackDomain(const VpnConnection *conn);
+    void untrackDomain(const VpnConnection *conn);
+    void resetDomains();
     void reorderConnection(VpnConnection * conn);
     virtual void orderConnections(QVector<VpnConnection*> &connections) override;
     bool compareConnections(const VpnConnection *i, const VpnConnection *j);
-    QVariantMap processOpenVpnProvisioningFile(QFile &provisioningFile);
-    void updateBestState(VpnConnection::ConnectionState maxState);
+    QCollatorSortKey sortKey(const VpnConnection *conn);
+    void createProvisionedConnections(const QList<VpnProvisioning::Result> &results);
+    void referenceProvisionedFiles(const VpnConnection *conn);
+    void setBestState(VpnConnection::ConnectionState state);
+    void updateStatistics(VpnConnection *conn);
 
 private Q_SLOTS:
     void connectionAdded(const QString &path);
@@ -106,13 +144,19 @@ private Q_SLOTS:
     void connectionsRefreshed();
     void updatedConnectionPosition();
     void connectedChanged();
+    void domainChanged();
+    void providerPropertiesChanged();
+    void updateStatisticsSampling();
+    void sampleStatistics();
     void stateChanged();
+    void indexChanged();
 
 private:
     class CredentialsRepository
     {
     public:
         CredentialsRepository(const QString &path);
+        ~CredentialsRepository();
 
         static QString locationForObjectPath(const QString &path);
 
@@ -127,15 +171,40 @@ private:
         static QVariantMap decodeCredentials(const QByteArray &encoded);
 
     private:
+        bool watchDirectory();
+        void readEvents();
+        void rescan();
+
         QDir baseDir_;
+        int inotifyFd_;
+        int watch_;
+        // Null if the directory can't be watched, credentialsExist tests the FS then
+        QScopedPointer<QSocketNotifier> notifier_;
+        QSet<QString> locations_;
     };
 
     CredentialsRepository credentials_;
     VpnConnection::ConnectionState bestState_;
+    QScopedPointer<VpnStateCounter> stateCounter_;
     // True if there's one VPN that has autoConnect true
     bool autoConnect_;
     bool orderByConnected_;
+    QCollator collator_;
+    // Collation keys of connection names, dropped when the name changes
+    QHash<const VpnConnection *, QCollatorSortKey> sortKeys_;
     QString provisioningOutputPath_;
+    // Shared with the import workers, which may outlive the model
+    QSharedPointer<VpnProvisioningStore> provisioningStore_;
+    bool importingProvisioningFiles_;
+    // Default domain suffixes in use (0 is the bare default domain) with their use counts
+    QHash<int, int> defaultDomainUsage_;
+    QHash<const VpnConnection *, int> defaultDomainSuffixes_;
+    // Handed out by createDefaultDomain but not seen on a connection yet
+    QHash<int, DomainReservation> reservedDefaultDomains_;
+    int firstFreeDefaultDomain_;
+    // Traffic statistics while connections are ready, sampled only while someone listens
+    QHash<const VpnConnection *, QSharedPointer<VpnStatistics>> statistics_;
+    QTimer *statisticsTimer_;
     QHash<int, QByteArray> roles;
 };
 
@@ -2,12 +2,12 @@ TEMPLATE = lib
 TARGET = systemsettings
 
 CONFIG += qt create_pc create_prl no_install_prl c++11
-QT += qml dbus systeminfo
+QT += qml dbus systeminfo concurrent
 QT -= gui
 
 CONFIG += c++11 hide_symbols link_pkgconfig
 PKGCONFIG += profile mlite5 mce timed-qt5 blkid libcrypto nemomodels-qt5 libsailfishkeyprovider connman-qt5 glib-2.0
-PKGCONFIG += ssu-sysinfo nemodbus packagekitqt5 libsystemd sailfishusermanager sailfishaccesscontrol
+PKGCONFIG += ssu-sysinfo nemodbus packagekitqt5 libsystemd sailfishusermanager
 
 system(qdbusxml2cpp -p mceiface.h:mceiface.cpp mce.xml)
 
@@ -32,14 +32,22 @@ SOURCES += \
     partitionmodel.cpp \
     deviceinfo.cpp \
     locationsettings.cpp \
+    seatmonitor.cpp \
     settingsvpnmodel.cpp \
     timezoneinfo.cpp \
     udisks2block.cpp \
     udisks2blockdevices.cpp \
     udisks2job.cpp \
     udisks2monitor.cpp \
+    userdatabase.cpp \
     userinfo.cpp \
-    usermodel.cpp
+    usermodel.cpp \
+    userstatistics.cpp \
+    vpnprovisioning.cpp \
+    vpnstatistics.cpp \
+    profilestore.cpp \
+    vpnstatecounter.cpp \
+    usermodelrows.cpp
 
 PUBLIC_HEADERS = \
     languagemodel.h \
@@ -78,10 +86,19 @@ HEADERS += \
     nfcsettings.h \
     partition_p.h \
     partitionmanager_p.h \
+    seatmonitor_p.h \
     udisks2blockdevices_p.h \
     udisks2job_p.h \
     udisks2monitor_p.h \
-    userinfo_p.h
+    userdatabase_p.h \
+    userinfo_p.h \
+    usermodel_p.h \
+    userstatistics_p.h \
+    vpnprovisioning_p.h \
+    vpnstatistics_p.h \
+    profilestore_p.h \
+    vpnstatecounter_p.h \
+    usermodelrows_p.h
 
 DEFINES += \
     SYSTEMSETTINGS_BUILD_LIBRARY
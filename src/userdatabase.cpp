@@ -0,0 +1,427 @@
+/*
+ * Copyright (C) 2020 Open Mobile Platform LLC.
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+#include "userdatabase_p.h"
+#include "logging_p.h"
+
+#include <QCoreApplication>
+#include <QFile>
+#include <QFileSystemWatcher>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSet>
+#include <QTimer>
+#include <errno.h>
+#include <grp.h>
+#include <pwd.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+namespace {
+
+const char *UserDatabaseFile = "/etc/passwd";
+const char *GroupDatabaseFile = "/etc/group";
+
+// Initial size of the line buffer, grown as needed for long group lines
+const size_t InitialBufferSize = 1024;
+
+// Tools like useradd write both databases, handle them in one go
+const int UpdateDelay = 100; // ms
+
+QMutex s_mutex;
+UserDatabase::SnapshotPointer s_snapshot;
+
+QString nameFromGecos(const char *gecos)
+{
+    // typically GECOS has (sub)fields separated by ","
+    // and the first one of them is full name of the user.
+    // Sometimes it contains just the full name or it might be empty,
+    // thus do this on best effort basis.
+    auto name = QString::fromUtf8(gecos);
+    int i = name.indexOf(QStringLiteral(","));
+    if (i != -1)
+        name.truncate(i);
+    return name;
+}
+
+}
+
+const UserDatabase::User *UserDatabase::Snapshot::user(uid_t uid) const
+{
+    auto iter = m_uidIndex.constFind(uid);
+    return iter != m_uidIndex.constEnd() ? &m_users.at(iter.value()) : nullptr;
+}
+
+const UserDatabase::User *UserDatabase::Snapshot::user(const QString &username) const
+{
+    auto iter = m_usernameIndex.constFind(username);
+    return iter != m_usernameIndex.constEnd() ? &m_users.at(iter.value()) : nullptr;
+}
+
+const UserDatabase::Group *UserDatabase::Snapshot::group(const QString &name) const
+{
+    auto iter = m_groupIndex.constFind(name);
+    return iter != m_groupIndex.constEnd() ? &m_groups.at(iter.value()) : nullptr;
+}
+
+/**
+ * Returns true if the user belongs to the group either as primary or as supplementary group
+ */
+bool UserDatabase::Snapshot::isMember(uid_t uid, const QString &group) const
+{
+    auto groupIter = m_groupIndex.constFind(group);
+    if (groupIter == m_groupIndex.constEnd())
+        return false;
+    auto iter = m_membership.constFind(uid);
+    return iter != m_membership.constEnd() && iter.value().testBit(groupIter.value());
+}
+
+/**
+ * Returns the membership bitmap of the user, indexed like groups()
+ */
+QBitArray UserDatabase::Snapshot::membership(uid_t uid) const
+{
+    return m_membership.value(uid);
+}
+
+QStringList UserDatabase::Snapshot::groupNames(uid_t uid) const
+{
+    QStringList names;
+    auto iter = m_membership.constFind(uid);
+    if (iter != m_membership.constEnd()) {
+        const QBitArray &bits = iter.value();
+        for (int i = 0; i < bits.size(); ++i) {
+            if (bits.testBit(i))
+                names.append(m_groups.at(i).name);
+        }
+    }
+    return names;
+}
+
+/**
+ * Returns the current snapshot, building it on first use
+ */
+UserDatabase::SnapshotPointer UserDatabase::snapshot()
+{
+    QMutexLocker locker(&s_mutex);
+    if (s_snapshot.isNull())
+        s_snapshot = build();
+    return s_snapshot;
+}
+
+/**
+ * Rebuilds the snapshot if the database files have changed on disk
+ *
+ * Returns the snapshot that is current after the check. Existing
+ * holders of the previous snapshot keep their copy unmodified.
+ */
+UserDatabase::SnapshotPointer UserDatabase::reload()
+{
+    QMutexLocker locker(&s_mutex);
+    if (!s_snapshot.isNull()) {
+        Snapshot::FileStamp userStamp;
+        Snapshot::FileStamp groupStamp;
+        if (stamp(UserDatabaseFile, &userStamp) && sameStamp(userStamp, s_snapshot->m_userStamp)
+                && stamp(GroupDatabaseFile, &groupStamp) && sameStamp(groupStamp, s_snapshot->m_groupStamp)) {
+            return s_snapshot;
+        }
+    }
+    s_snapshot = build();
+    return s_snapshot;
+}
+
+UserDatabase::SnapshotPointer UserDatabase::build()
+{
+    QSharedPointer<Snapshot> snapshot(new Snapshot);
+    std::vector<char> buffer(InitialBufferSize);
+
+    // Take the stamps before reading so that a write racing with the
+    // parsing is noticed on the next reload
+    if (!stamp(UserDatabaseFile, &snapshot->m_userStamp))
+        memset(&snapshot->m_userStamp, 0, sizeof(Snapshot::FileStamp));
+    if (!stamp(GroupDatabaseFile, &snapshot->m_groupStamp))
+        memset(&snapshot->m_groupStamp, 0, sizeof(Snapshot::FileStamp));
+
+    FILE *file = fopen(UserDatabaseFile, "re");
+    if (!file) {
+        qCWarning(lcUsersLog) << "Could not read user database:" << strerror(errno);
+    } else {
+        struct passwd pwd;
+        struct passwd *result;
+        int error;
+        while ((error = fgetpwent_r(file, &pwd, buffer.data(), buffer.size(), &result)) != ENOENT) {
+            if (error == ERANGE) {
+                buffer.resize(buffer.size() * 2);
+                continue;
+            } else if (error != 0) {
+                qCWarning(lcUsersLog) << "Could not parse user database:" << strerror(error);
+                break;
+            }
+            if (snapshot->m_uidIndex.contains(result->pw_uid))
+                continue; // First entry wins like with getpwuid()
+            User user;
+            user.uid = result->pw_uid;
+            user.gid = result->pw_gid;
+            user.username = QString::fromUtf8(result->pw_name);
+            user.name = nameFromGecos(result->pw_gecos);
+            user.home = QString::fromUtf8(result->pw_dir);
+            snapshot->m_uidIndex.insert(user.uid, snapshot->m_users.count());
+            snapshot->m_usernameIndex.insert(user.username, snapshot->m_users.count());
+            snapshot->m_users.append(user);
+        }
+        fclose(file);
+    }
+
+    file = fopen(GroupDatabaseFile, "re");
+    if (!file) {
+        qCWarning(lcUsersLog) << "Could not read group database:" << strerror(errno);
+    } else {
+        struct group grp;
+        struct group *result;
+        int error;
+        while ((error = fgetgrent_r(file, &grp, buffer.data(), buffer.size(), &result)) != ENOENT) {
+            if (error == ERANGE) {
+                buffer.resize(buffer.size() * 2);
+                continue;
+            } else if (error != 0) {
+                qCWarning(lcUsersLog) << "Could not parse group database:" << strerror(error);
+                break;
+            }
+            Group group;
+            group.gid = result->gr_gid;
+            group.name = QString::fromUtf8(result->gr_name);
+            if (snapshot->m_groupIndex.contains(group.name))
+                continue; // First entry wins like with getgrnam()
+            for (int i = 0; result->gr_mem[i] != nullptr; ++i)
+                group.members.append(QString::fromUtf8(result->gr_mem[i]));
+            snapshot->m_groupIndex.insert(group.name, snapshot->m_groups.count());
+            snapshot->m_groups.append(group);
+        }
+        fclose(file);
+    }
+
+    // Precompute group memberships of all users
+    QHash<gid_t, int> gidIndex;
+    for (int i = snapshot->m_groups.count() - 1; i >= 0; --i)
+        gidIndex.insert(snapshot->m_groups.at(i).gid, i);
+    for (const User &user : snapshot->m_users) {
+        QBitArray bits(snapshot->m_groups.count());
+        int primary = gidIndex.value(user.gid, -1);
+        if (primary >= 0)
+            bits.setBit(primary);
+        snapshot->m_membership.insert(user.uid, bits);
+    }
+    for (int i = 0; i < snapshot->m_groups.count(); ++i) {
+        for (const QString &member : snapshot->m_groups.at(i).members) {
+            auto user = snapshot->m_usernameIndex.constFind(member);
+            if (user != snapshot->m_usernameIndex.constEnd())
+                snapshot->m_membership[snapshot->m_users.at(user.value()).uid].setBit(i);
+        }
+    }
+
+    qCDebug(lcUsersLog) << "Read" << snapshot->m_users.count() << "users and"
+                        << snapshot->m_groups.count() << "groups";
+    return snapshot;
+}
+
+bool UserDatabase::stamp(const char *path, Snapshot::FileStamp *stamp)
+{
+    struct stat buf;
+    if (stat(path, &buf) < 0)
+        return false;
+    stamp->device = buf.st_dev;
+    stamp->inode = buf.st_ino;
+    stamp->size = buf.st_size;
+    stamp->modified = buf.st_mtim;
+    return true;
+}
+
+bool UserDatabase::sameStamp(const Snapshot::FileStamp &a, const Snapshot::FileStamp &b)
+{
+    return a.device == b.device && a.inode == b.inode && a.size == b.size
+            && a.modified.tv_sec == b.modified.tv_sec && a.modified.tv_nsec == b.modified.tv_nsec;
+}
+
+UserDatabaseWatcher *UserDatabaseWatcher::sharedInstance = nullptr;
+
+UserDatabaseWatcher *UserDatabaseWatcher::instance()
+{
+    return sharedInstance ? sharedInstance : new UserDatabaseWatcher;
+}
+
+UserDatabaseWatcher::UserDatabaseWatcher()
+    : QObject(QCoreApplication::instance())
+    , m_watcher(new QFileSystemWatcher(this))
+    , m_updateTimer(new QTimer(this))
+{
+    Q_ASSERT(!sharedInstance);
+    sharedInstance = this;
+
+    m_updateTimer->setSingleShot(true);
+    m_updateTimer->setInterval(UpdateDelay);
+    connect(m_updateTimer, &QTimer::timeout, this, &UserDatabaseWatcher::update);
+
+    const QStringList paths = {
+        QString::fromLatin1(UserDatabaseFile),
+        QString::fromLatin1(GroupDatabaseFile)
+    };
+    QStringList missing = m_watcher->addPaths(paths);
+    if (missing.count() == paths.count()) {
+        qCWarning(lcUsersLog) << "Could not watch for changes in user or group database";
+    } else {
+        if (missing.count() > 0)
+            qCWarning(lcUsersLog) << "Could not watch for changes in" << missing;
+        connect(m_watcher, &QFileSystemWatcher::fileChanged, this, &UserDatabaseWatcher::fileChanged);
+    }
+}
+
+UserDatabaseWatcher::~UserDatabaseWatcher()
+{
+    sharedInstance = nullptr;
+}
+
+/**
+ * Sets the snapshot that the next change is compared to
+ *
+ * The watcher does not read the databases on construction. Readers
+ * that build the first snapshot in a worker thread hand it over here
+ * so that changes made after that are not missed. Has no effect if
+ * the watcher already holds a snapshot.
+ */
+void UserDatabaseWatcher::adopt(const UserDatabase::SnapshotPointer &snapshot)
+{
+    if (m_snapshot.isNull())
+        m_snapshot = snapshot;
+}
+
+/**
+ * Returns true if at least one of the databases is followed
+ */
+bool UserDatabaseWatcher::isWatching() const
+{
+    return !m_watcher->files().isEmpty();
+}
+
+/**
+ * Checks the databases for changes now instead of waiting for the notification
+ *
+ * Change signals are emitted before this returns. Use this after
+ * making changes to the databases to have them applied immediately.
+ */
+void UserDatabaseWatcher::refresh()
+{
+    m_updateTimer->stop();
+    update();
+}
+
+void UserDatabaseWatcher::fileChanged(const QString &path)
+{
+    // The files are usually replaced rather than modified in place
+    if (!m_watcher->files().contains(path)) {
+        if (QFile::exists(path) && m_watcher->addPath(path)) {
+            qCDebug(lcUsersLog) << "Re-watching" << path << "for changes";
+        } else {
+            qCWarning(lcUsersLog) << "Stopped watching" << path << "for changes";
+        }
+    }
+    m_updateTimer->start();
+}
+
+void UserDatabaseWatcher::update()
+{
+    // Nobody handed over a snapshot, compare to whatever was read last
+    auto previous = m_snapshot.isNull() ? UserDatabase::snapshot() : m_snapshot;
+    m_snapshot = UserDatabase::reload();
+    if (m_snapshot == previous)
+        return;
+
+    qCDebug(lcUsersLog) << "User or group database changed, updating data";
+
+    QList<uint> added;
+    QList<uint> modified;
+    QList<uint> removed;
+    for (const UserDatabase::User &user : m_snapshot->users()) {
+        const UserDatabase::User *old = previous->user(user.uid);
+        if (!old) {
+            added.append(user.uid);
+        } else if (old->username != user.username || old->name != user.name
+                   || old->gid != user.gid || old->home != user.home) {
+            modified.append(user.uid);
+        }
+    }
+    for (const UserDatabase::User &user : previous->users()) {
+        if (!m_snapshot->user(user.uid))
+            removed.append(user.uid);
+    }
+
+    bool groupsDiffer = m_snapshot->groups().count() != previous->groups().count();
+    for (const UserDatabase::Group &group : m_snapshot->groups()) {
+        const UserDatabase::Group *old = previous->group(group.name);
+        if (!old || old->gid != group.gid || old->members != group.members) {
+            groupsDiffer = true;
+            break;
+        }
+    }
+
+    // Collect the users whose memberships differ, primary group included.
+    // The bitmaps can be compared as such only if the groups kept their order.
+    bool sameOrder = m_snapshot->groups().count() == previous->groups().count();
+    if (sameOrder) {
+        for (int i = 0; i < m_snapshot->groups().count(); ++i) {
+            if (m_snapshot->groups().at(i).name != previous->groups().at(i).name) {
+                sameOrder = false;
+                break;
+            }
+        }
+    }
+    QList<uint> regrouped;
+    for (const UserDatabase::User &user : m_snapshot->users()) {
+        if (!previous->user(user.uid))
+            continue;
+        bool differ = sameOrder
+                ? m_snapshot->membership(user.uid) != previous->membership(user.uid)
+                : m_snapshot->groupNames(user.uid).toSet() != previous->groupNames(user.uid).toSet();
+        if (differ)
+            regrouped.append(user.uid);
+    }
+
+    for (uint uid : removed)
+        emit userRemoved(uid);
+    for (uint uid : added)
+        emit userAdded(uid);
+    for (uint uid : modified)
+        emit userModified(uid);
+    for (uint uid : regrouped)
+        emit userGroupsChanged(uid);
+    if (groupsDiffer)
+        emit groupsChanged();
+}
@@ -0,0 +1,161 @@
+/*
+ * Copyright (C) 2020 Open Mobile Platform LLC.
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+#ifndef USERDATABASE_P_H
+#define USERDATABASE_P_H
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <QBitArray>
+#include <QHash>
+#include <QObject>
+#include <QSharedPointer>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+class QFileSystemWatcher;
+class QTimer;
+
+/**
+ * Process-wide view of the user and group databases
+ *
+ * /etc/passwd and /etc/group are parsed once into an immutable
+ * snapshot that is indexed by uid, username and group name. All
+ * readers share the same snapshot, and a new one is built and swapped
+ * in only when the files on disk have changed.
+ */
+class UserDatabase
+{
+public:
+    struct User {
+        uid_t uid;
+        gid_t gid;
+        QString username;
+        QString name;
+        QString home;
+    };
+
+    struct Group {
+        gid_t gid;
+        QString name;
+        QStringList members;
+    };
+
+    class Snapshot
+    {
+    public:
+        const User *user(uid_t uid) const;
+        const User *user(const QString &username) const;
+        const Group *group(const QString &name) const;
+
+        bool isMember(uid_t uid, const QString &group) const;
+        QBitArray membership(uid_t uid) const;
+        QStringList groupNames(uid_t uid) const;
+
+        const QVector<User> &users() const { return m_users; }
+        const QVector<Group> &groups() const { return m_groups; }
+
+    private:
+        friend class UserDatabase;
+
+        struct FileStamp {
+            dev_t device;
+            ino_t inode;
+            off_t size;
+            struct timespec modified;
+        };
+
+        QVector<User> m_users;
+        QVector<Group> m_groups;
+        QHash<uid_t, int> m_uidIndex;
+        QHash<QString, int> m_usernameIndex;
+        QHash<QString, int> m_groupIndex;
+        // Bit i is set if the user belongs to m_groups[i], primary group included
+        QHash<uid_t, QBitArray> m_membership;
+        FileStamp m_userStamp;
+        FileStamp m_groupStamp;
+    };
+
+    typedef QSharedPointer<const Snapshot> SnapshotPointer;
+
+    static SnapshotPointer snapshot();
+    static SnapshotPointer reload();
+
+private:
+    static SnapshotPointer build();
+    static bool stamp(const char *path, Snapshot::FileStamp *stamp);
+    static bool sameStamp(const Snapshot::FileStamp &a, const Snapshot::FileStamp &b);
+};
+
+/**
+ * Follows changes in the user and group databases
+ *
+ * There is only one watcher per process. On change the databases are
+ * parsed once and the new snapshot is compared to the previous one so
+ * that only the affected users are notified. Creating the watcher does
+ * not read the databases.
+ */
+class UserDatabaseWatcher : public QObject
+{
+    Q_OBJECT
+
+public:
+    static UserDatabaseWatcher *instance();
+
+    void adopt(const UserDatabase::SnapshotPointer &snapshot);
+    void refresh();
+    bool isWatching() const;
+
+signals:
+    void userAdded(uint uid);
+    void userModified(uint uid);
+    void userRemoved(uint uid);
+    void userGroupsChanged(uint uid);
+    void groupsChanged();
+
+private slots:
+    void fileChanged(const QString &path);
+    void update();
+
+private:
+    UserDatabaseWatcher();
+    ~UserDatabaseWatcher();
+
+    static UserDatabaseWatcher *sharedInstance;
+
+    QFileSystemWatcher *m_watcher;
+    QTimer *m_updateTimer;
+    UserDatabase::SnapshotPointer m_snapshot;
+};
+
+#endif /* USERDATABASE_P_H */
@@ -31,41 +31,34 @@
 
 #include "userinfo.h"
 #include "userinfo_p.h"
+#include "userdatabase_p.h"
+#include "seatmonitor_p.h"
 #include "logging_p.h"
 
-#include <QFile>
-#include <QFileSystemWatcher>
-#include <QSocketNotifier>
-#include <grp.h>
-#include <poll.h>
-#include <pwd.h>
 #include <sys/types.h>
-#include <systemd/sd-login.h>
 
 #include <sailfishusermanagerinterface.h>
 
 namespace {
 
-const auto UserDatabaseFile = QStringLiteral("/etc/passwd");
-const auto GroupDatabaseFile = QStringLiteral("/etc/group");
-
 enum SpecialIds : uid_t {
     DeviceOwnerId = 100000,
     UnknownCurrentUserId = (uid_t)(-2),
     InvalidId = (uid_t)(-1),
 };
 
-QString nameFromGecos(const char *gecos)
+// Returned user is valid as long as snapshot is held
+template <typename Key>
+const UserDatabase::User *findUser(const Key &key, UserDatabase::SnapshotPointer *snapshot)
 {
-    // typically GECOS has (sub)fields separated by ","
-    // and the first one of them is full name of the user.
-    // Sometimes it contains just the full name or it might be empty,
-    // thus do this on best effort basis.
-    auto name = QString::fromUtf8(gecos);
-    int i = name.indexOf(QStringLiteral(","));
-    if (i != -1)
-        name.truncate(i);
-    return name;
+    *snapshot = UserDatabase::snapshot();
+    const UserDatabase::User *user = (*snapshot)->user(key);
+    if (!user) {
+        // The user may have been just added, e.g. by user-managerd
+        *snapshot = UserDatabase::reload();
+        user = (*snapshot)->user(key);
+    }
+    return user;
 }
 
 }
@@ -73,40 +66,51 @@ QString nameFromGecos(const char *gecos)
 UserInfoPrivate::UserInfoPrivate()
     : m_uid(InvalidId)
     , m_loggedIn(false)
-    , m_watcher(nullptr)
+    , m_watched(false)
     , m_alone(Unknown)
+{
+    connect(SeatMonitor::instance(), &SeatMonitor::activeUidChanged,
+            this, &UserInfoPrivate::activeUidChanged);
+}
+
+UserInfoPrivate::UserInfoPrivate(const UserDatabase::User *user)
+    // Only the active user on seat0 is logged in. Remote users
+    // are not counted as they don't have seats.
+    : UserInfoPrivate(user, user->uid == SeatMonitor::instance()->activeUid())
 {
 }
 
-UserInfoPrivate::UserInfoPrivate(struct passwd *pwd)
-    : m_uid(pwd->pw_uid)
-    , m_username(QString::fromUtf8(pwd->pw_name))
-    , m_name(nameFromGecos(pwd->pw_gecos))
-    // require_active == true -> only active user is logged in.
-    // Specifying seat should make sure that remote users are not
-    // counted as they don't have seats.
-    , m_loggedIn(sd_uid_is_on_seat(m_uid, 1, "seat0") > 0)
-    , m_watcher(nullptr)
+/*
+ * Does not read the active user, thus this may be used in a worker
+ * thread with a SeatMonitor that already exists
+ */
+UserInfoPrivate::UserInfoPrivate(const UserDatabase::User *user, bool loggedIn)
+    : m_uid(user->uid)
+    , m_username(user->username)
+    , m_name(user->name)
+    , m_loggedIn(loggedIn)
+    , m_watched(false)
     , m_alone(Unknown)
 {
+    connect(SeatMonitor::instance(), &SeatMonitor::activeUidChanged,
+            this, &UserInfoPrivate::activeUidChanged);
 }
 
 UserInfoPrivate::~UserInfoPrivate()
 {
-    delete m_watcher;
 }
 
 QWeakPointer<UserInfoPrivate> UserInfoPrivate::s_current;
 
-void UserInfoPrivate::set(struct passwd *pwd)
+void UserInfoPrivate::set(const UserDatabase::User *user)
 {
     QString username;
     QString name;
 
-    if (pwd) {
-        Q_ASSERT(pwd->pw_uid == m_uid);
-        username = QString::fromUtf8(pwd->pw_name);
-        name = nameFromGecos(pwd->pw_gecos);
+    if (user) {
+        Q_ASSERT(user->uid == m_uid);
+        username = user->username;
+        name = user->name;
     } else if (m_uid != InvalidId) {
         m_uid = InvalidId;
         emit uidChanged();
@@ -127,6 +131,82 @@ void UserInfoPrivate::set(struct passwd *pwd)
     }
 }
 
+bool UserInfoPrivate::isValid() const
+{
+    return m_uid != InvalidId && m_uid != UnknownCurrentUserId;
+}
+
+QString UserInfoPrivate::displayName() const
+{
+    if (m_name.isEmpty()) {
+        if (type() == UserInfo::DeviceOwner) {
+            //: Default value for device owner's name when it is not set
+            //% "Device owner"
+            return qtTrId("systemsettings-li-device_owner");
+        } else if (m_uid == SAILFISH_USERMANAGER_GUEST_UID) {
+            //: Default value for guest user's name when it is not set
+            //% "Guest user"
+            return qtTrId("systemsettings-li-guest_user");
+        }
+        return m_username;
+    }
+    return m_name;
+}
+
+UserInfo::UserType UserInfoPrivate::type() const
+{
+    // Device lock considers user with id 100000 as device owner.
+    // Some other places consider the user belonging to sailfish-system
+    // as device owner. We have to pick one here.
+    switch (m_uid) {
+    case DeviceOwnerId:
+        return UserInfo::DeviceOwner;
+    case SAILFISH_USERMANAGER_GUEST_UID:
+        return UserInfo::Guest;
+    default:
+        return UserInfo::User;
+    }
+}
+
+void UserInfoPrivate::setName(const QString &name)
+{
+    if (m_name != name) {
+        m_name = name;
+        emit nameChanged();
+        emit displayNameChanged();
+    }
+}
+
+/**
+ * Reloads all information
+ */
+void UserInfoPrivate::reset()
+{
+    set(isValid() ? UserDatabase::reload()->user(m_uid) : nullptr);
+    updateCurrent(SeatMonitor::instance()->activeUid());
+    updateAlone();
+}
+
+bool UserInfoPrivate::updateCurrent(uid_t activeUid)
+{
+    bool loggedIn = m_uid != InvalidId && m_uid == activeUid;
+    if (m_loggedIn == loggedIn)
+        return false;
+
+    m_loggedIn = loggedIn;
+    if (m_loggedIn)
+        s_current = sharedFromThis();
+    else if (s_current == sharedFromThis())
+        s_current.clear();
+    emit currentChanged();
+    return true;
+}
+
+void UserInfoPrivate::activeUidChanged(uint uid)
+{
+    updateCurrent((uid_t)uid);
+}
+
 bool UserInfoPrivate::alone()
 {
     if (m_alone == Unknown)
@@ -149,22 +229,20 @@ void UserInfoPrivate::updateAlone(bool force)
         alone = No;
     } else {
         // Can not determine from uid, check users group
-        errno = 0;
-        struct group *grp = getgrnam("users");
+        auto snapshot = UserDatabase::snapshot();
+        const UserDatabase::Group *grp = snapshot->group(QStringLiteral("users"));
         if (!grp) {
-            qCWarning(lcUsersLog) << "Could not read users group:" << strerror(errno);
+            qCWarning(lcUsersLog) << "Could not read users group";
             // Guessing that user is probably alone
         } else {
-            for (int i = 0; grp->gr_mem[i] != nullptr; ++i) {
-                struct passwd *pwd = getpwnam(grp->gr_mem[i]);
-                if (pwd && pwd->pw_uid != DeviceOwnerId) {
+            for (const QString &member : grp->members) {
+                const UserDatabase::User *user = snapshot->user(member);
+                if (user && user->uid != DeviceOwnerId) {
                     // Found someone that's not device owner
                     alone = No;
                     break;
                 }
-                // pwd must not be free'd
             }
-            // grp must not be free'd
         }
     }
 
@@ -190,11 +268,12 @@ UserInfo::UserInfo()
 {
     d_ptr = UserInfoPrivate::s_current.toStrongRef();
     if (d_ptr.isNull()) {
-        uid_t uid = InvalidId;
-        struct passwd *pwd;
-        if (sd_seat_get_active("seat0", NULL, &uid) >= 0 && uid != InvalidId) {
-            if ((pwd = getpwuid(uid))) {
-                d_ptr = QSharedPointer<UserInfoPrivate>(new UserInfoPrivate(pwd));
+        uid_t uid = SeatMonitor::instance()->activeUid();
+        UserDatabase::SnapshotPointer snapshot;
+        const UserDatabase::User *user;
+        if (uid != InvalidId) {
+            if ((user = findUser(uid, &snapshot))) {
+                d_ptr = QSharedPointer<UserInfoPrivate>(new UserInfoPrivate(user));
             } else {
                 // User did not exist, should not happen
                 d_ptr = QSharedPointer<UserInfoPrivate>(new UserInfoPrivate);
@@ -205,7 +284,6 @@ UserInfo::UserInfo()
             d_ptr->m_uid = UnknownCurrentUserId;
             waitForActivation();
         }
-        // pwd must not be free'd
         if (current())
             UserInfoPrivate::s_current = d_ptr;
     }
@@ -228,13 +306,13 @@ UserInfo::UserInfo(int uid)
     if (!current_d.isNull() && current_d->m_uid == (uid_t)uid) {
         d_ptr = current_d;
     } else {
-        struct passwd *pwd = (uid_t)uid != InvalidId ? getpwuid((uid_t)uid) : nullptr;
-        if (pwd) {
-            d_ptr = QSharedPointer<UserInfoPrivate>(new UserInfoPrivate(pwd));
+        UserDatabase::SnapshotPointer snapshot;
+        const UserDatabase::User *user = (uid_t)uid != InvalidId ? findUser((uid_t)uid, &snapshot) : nullptr;
+        if (user) {
+            d_ptr = QSharedPointer<UserInfoPrivate>(new UserInfoPrivate(user));
         } else {
             d_ptr = QSharedPointer<UserInfoPrivate>(new UserInfoPrivate);
         }
-        // pwd must not be free'd
         if (current())
             UserInfoPrivate::s_current = d_ptr;
     }
@@ -250,13 +328,13 @@ UserInfo::UserInfo(QString username)
     if (!current_d.isNull() && current_d->m_username == username) {
         d_ptr = current_d;
     } else {
-        struct passwd *pwd = getpwnam(username.toUtf8().constData());
-        if (pwd) {
-            d_ptr = QSharedPointer<UserInfoPrivate>(new UserInfoPrivate(pwd));
+        UserDatabase::SnapshotPointer snapshot;
+        const UserDatabase::User *user = findUser(username, &snapshot);
+        if (user) {
+            d_ptr = QSharedPointer<UserInfoPrivate>(new UserInfoPrivate(user));
         } else {
             d_ptr = QSharedPointer<UserInfoPrivate>(new UserInfoPrivate);
         }
-        // pwd must not be free'd
         if (current())
             UserInfoPrivate::s_current = d_ptr;
     }
@@ -283,25 +361,13 @@ UserInfo::~UserInfo()
 bool UserInfo::isValid() const
 {
     Q_D(const UserInfo);
-    return d->m_uid != InvalidId && d->m_uid != UnknownCurrentUserId;
+    return d->isValid();
 }
 
 QString UserInfo::displayName() const
 {
     Q_D(const UserInfo);
-    if (d->m_name.isEmpty()) {
-        if (type() == DeviceOwner) {
-            //: Default value for device owner's name when it is not set
-            //% "Device owner"
-            return qtTrId("systemsettings-li-device_owner");
-        } else if (d->m_uid == SAILFISH_USERMANAGER_GUEST_UID) {
-            //: Default value for guest user's name when it is not set
-            //% "Guest user"
-            return qtTrId("systemsettings-li-guest_user");
-        }
-        return d->m_username;
-    }
-    return d->m_name;
+    return d->displayName();
 }
 
 QString UserInfo::username() const
@@ -330,27 +396,13 @@ QString UserInfo::name() const
 void UserInfo::setName(QString name)
 {
     Q_D(UserInfo);
-    if (d->m_name != name) {
-        d->m_name = name;
-        emit d_ptr->nameChanged();
-        emit d_ptr->displayNameChanged();
-    }
+    d->setName(name);
 }
 
 UserInfo::UserType UserInfo::type() const
 {
     Q_D(const UserInfo);
-    // Device lock considers user with id 100000 as device owner.
-    // Some other places consider the user belonging to sailfish-system
-    // as device owner. We have to pick one here.
-    switch (d->m_uid) {
-    case DeviceOwnerId:
-        return DeviceOwner;
-    case SAILFISH_USERMANAGER_GUEST_UID:
-        return Guest;
-    default:
-        return User;
-    }
+    return d->type();
 }
 
 int UserInfo::uid() const
@@ -380,17 +432,7 @@ bool UserInfo::current() const
 bool UserInfo::updateCurrent()
 {
     Q_D(UserInfo);
-    bool previous = d->m_loggedIn;
-    d->m_loggedIn = sd_uid_is_on_seat(d->m_uid, 1, "seat0") > 0;
-    if (d->m_loggedIn != previous) {
-        if (d->m_loggedIn)
-            UserInfoPrivate::s_current = d_ptr;
-        else if (UserInfoPrivate::s_current == d_ptr)
-            UserInfoPrivate::s_current.clear();
-        emit d_ptr->currentChanged();
-        return true;
-    }
-    return false;
+    return d->updateCurrent(SeatMonitor::instance()->activeUid());
 }
 
 /**
@@ -411,7 +453,7 @@ bool UserInfo::alone()
 bool UserInfo::watched()
 {
     Q_D(const UserInfo);
-    return (bool)d->m_watcher;
+    return d->m_watched;
 }
 
 /**
@@ -428,9 +470,9 @@ void UserInfo::setWatched(bool watch)
 {
     Q_D(UserInfo);
     // UserInfo objects with uid set to InvalidId can not be watched
-    if (d->m_uid != InvalidId && watch && !d->m_watcher) {
+    if (d->m_uid != InvalidId && watch && !d->m_watched) {
         watchForChanges();
-        if (d_ptr->m_watcher)
+        if (d_ptr->m_watched)
             emit d->watchedChanged();
     }
 }
@@ -441,9 +483,7 @@ void UserInfo::setWatched(bool watch)
 void UserInfo::reset()
 {
     Q_D(UserInfo);
-    d->set((isValid()) ? getpwuid(d->m_uid) : nullptr);
-    updateCurrent();
-    d->updateAlone();
+    d->reset();
 }
 
 void UserInfo::replace(QSharedPointer<UserInfoPrivate> other)
@@ -470,11 +510,11 @@ void UserInfo::replace(QSharedPointer<UserInfoPrivate> other)
     if (old->m_loggedIn != d_ptr->m_loggedIn)
         emit currentChanged();
 
-    if (old->m_watcher && !d_ptr->m_watcher) {
+    if (old->m_watched && !d_ptr->m_watched) {
         watchForChanges();
-        if (!d_ptr->m_watcher)
+        if (!d_ptr->m_watched)
             emit watchedChanged();
-    } else if (!old->m_watcher && d_ptr->m_watcher) {
+    } else if (!old->m_watched && d_ptr->m_watched) {
         emit watchedChanged();
     }
 
@@ -523,82 +563,49 @@ void UserInfo::connectSignals()
 void UserInfo::watchForChanges()
 {
     Q_D(UserInfo);
-    d->m_watcher = new QFileSystemWatcher(d);
-    QStringList missing = d->m_watcher->addPaths(QStringList() << UserDatabaseFile << GroupDatabaseFile);
-    if (missing.count() == 2) {
-        qCWarning(lcUsersLog) << "Could not watch for changes in user or group database";
-        delete d->m_watcher;
-        d->m_watcher = nullptr;
-    } else if (missing.count() > 0) {
-        qCWarning(lcUsersLog) << "Could not watch for changes in" << missing;
-    } else {
-        connect(d->m_watcher, &QFileSystemWatcher::fileChanged, d, &UserInfoPrivate::databaseChanged);
+    // All objects share the same watcher that parses the databases once per change
+    auto *watcher = UserDatabaseWatcher::instance();
+    if (watcher->isWatching()) {
+        connect(watcher, &UserDatabaseWatcher::userModified, d, &UserInfoPrivate::userModified);
+        connect(watcher, &UserDatabaseWatcher::userRemoved, d, &UserInfoPrivate::userRemoved);
+        connect(watcher, &UserDatabaseWatcher::groupsChanged, d, &UserInfoPrivate::groupsChanged);
+        d->m_watched = true;
     }
 }
 
-void UserInfoPrivate::databaseChanged(const QString &path)
+void UserInfoPrivate::userModified(uint uid)
 {
-    if (QFile::exists(path)) {
-        if (path == UserDatabaseFile) {
-            // User database updated, reset model
-            qCDebug(lcUsersLog) << "User database changed, updating data";
-            set(getpwuid(m_uid));
-        } else if (m_alone != Unknown) { // && path == GroupDatabaseFile
-            // Group database updated, update alone status
-            qCDebug(lcUsersLog) << "Group database changed, checking alone status again";
-            updateAlone();
-        }
+    if (uid == m_uid) {
+        qCDebug(lcUsersLog) << "User" << uid << "changed, updating data";
+        set(UserDatabase::snapshot()->user(m_uid));
     }
-    if (!m_watcher->files().contains(path)) {
-        if (QFile::exists(path) && m_watcher->addPath(path)) {
-            qCDebug(lcUsersLog) << "Re-watching" << path << "for changes";
-        } else {
-            qCWarning(lcUsersLog) << "Stopped watching" << path << "for changes";
-        }
+}
+
+void UserInfoPrivate::userRemoved(uint uid)
+{
+    if (uid == m_uid) {
+        qCDebug(lcUsersLog) << "User" << uid << "was removed";
+        set(nullptr);
+        updateAlone();
+    }
+}
+
+void UserInfoPrivate::groupsChanged()
+{
+    if (m_alone != Unknown) {
+        // Group database updated, update alone status
+        qCDebug(lcUsersLog) << "Group database changed, checking alone status again";
+        updateAlone();
     }
 }
 
 void UserInfo::waitForActivation()
 {
-    // Monitor systemd-logind for changes on seats
-    sd_login_monitor *monitor;
-    if (sd_login_monitor_new("seat", &monitor) < 0) {
-        qCWarning(lcUsersLog) << "Could not start monitoring seat changes";
-    } else {
-        int fd = sd_login_monitor_get_fd(monitor);
-        if (fd < 0) {
-            qCWarning(lcUsersLog) << "Could not get file descriptor, not monitoring seat changes";
-            sd_login_monitor_unref(monitor);
-        } else if (!(sd_login_monitor_get_events(monitor) & POLLIN)) {
-            // Should not happen
-            qCWarning(lcUsersLog) << "Wrong events bits, not monitoring seat changes";
-            sd_login_monitor_unref(monitor);
-        } else {
-            auto *notifier = new QSocketNotifier(fd, QSocketNotifier::Read, this);
-            connect(notifier, &QSocketNotifier::activated, this, [this, notifier, monitor](int socket) {
-                Q_UNUSED(socket)
-                if (uid() != (int)UnknownCurrentUserId) {
-                    // This user has been changed to someone else already, stop monitoring
-                    qCDebug(lcUsersLog) << "UserInfo uid had been changed";
-                    notifier->deleteLater();
-                }
-                // Check if seat0 has got active user
-                uid_t uid = InvalidId;
-                if (sd_seat_get_active("seat0", NULL, &uid) >= 0 && uid != InvalidId) {
-                    qCDebug(lcUsersLog) << "User activated on seat0";
-                    replace(UserInfo().d_ptr);
-                    notifier->deleteLater();
-                // Otherwise it was not the event we are waiting for, just flush
-                } else if (sd_login_monitor_flush(monitor) < 0) {
-                    qCWarning(lcUsersLog) << "Monitor flush failed";
-                    notifier->deleteLater();
-                }
-            });
-            connect(notifier, &QObject::destroyed, [monitor] {
-                qCDebug(lcUsersLog) << "Stopped monitoring seat changes";
-                sd_login_monitor_unref(monitor);
-            });
-            qCDebug(lcUsersLog) << "Started monitoring seat changes";
+    // The shared seat monitor keeps running, just ignore changes after this has been resolved
+    connect(SeatMonitor::instance(), &SeatMonitor::activeUidChanged, this, [this](uint uid) {
+        if (this->uid() == (int)UnknownCurrentUserId && (uid_t)uid != InvalidId) {
+            qCDebug(lcUsersLog) << "User activated on seat0";
+            replace(UserInfo().d_ptr);
         }
-    }
+    });
 }
@@ -34,19 +34,22 @@
 
 #include <sys/types.h>
 
+#include <QEnableSharedFromThis>
 #include <QObject>
 #include <QString>
 #include <QWeakPointer>
 
-class QFileSystemWatcher;
+#include "userdatabase_p.h"
+#include "userinfo.h"
 
-class UserInfoPrivate : public QObject
+class UserInfoPrivate : public QObject, public QEnableSharedFromThis<UserInfoPrivate>
 {
     Q_OBJECT
 
 public:
     UserInfoPrivate();
-    UserInfoPrivate(struct passwd *pwd);
+    UserInfoPrivate(const UserDatabase::User *user);
+    UserInfoPrivate(const UserDatabase::User *user, bool loggedIn);
     ~UserInfoPrivate();
 
     enum Tristated {
@@ -60,15 +63,25 @@ public:
     QString m_name;
     bool m_loggedIn;
     static QWeakPointer<UserInfoPrivate> s_current;
-    QFileSystemWatcher *m_watcher;
+    bool m_watched;
     Tristated m_alone;
 
-    void set(struct passwd *pwd);
+    bool isValid() const;
+    QString displayName() const;
+    UserInfo::UserType type() const;
+    void setName(const QString &name);
+    void reset();
+
+    void set(const UserDatabase::User *user);
+    bool updateCurrent(uid_t activeUid);
     bool alone();
     void updateAlone(bool force = false);
 
 public slots:
-    void databaseChanged(const QString &path);
+    void activeUidChanged(uint uid);
+    void userModified(uint uid);
+    void userRemoved(uint uid);
+    void groupsChanged();
 
 signals:
     void displayNameChanged();
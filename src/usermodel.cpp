@@ -30,6 +30,11 @@
  */
 
 #include "usermodel.h"
+#include "usermodel_p.h"
+#include "userdatabase_p.h"
+#include "userinfo_p.h"
+#include "seatmonitor_p.h"
+#include "userstatistics_p.h"
 #include "logging_p.h"
 
 #include <QDBusConnection>
@@ -39,11 +44,11 @@
 #include <QDBusPendingCall>
 #include <QDBusPendingReply>
 #include <QDBusServiceWatcher>
+#include <QFutureWatcher>
 #include <QString>
+#include <QThread>
+#include <QtConcurrent/QtConcurrentRun>
 #include <functional>
-#include <grp.h>
-#include <pwd.h>
-#include <sailfishaccesscontrol.h>
 #include <sailfishusermanagerinterface.h>
 #include <sys/types.h>
 
@@ -74,14 +79,62 @@ int getErrorType(QDBusError &error)
 
     return errorTypeMap.value(error.name(), UserModel::OtherError);
 }
+
+// Parsing /etc/passwd and /etc/group into a snapshot is kept off the GUI thread
+UserModelPopulation readUsers(QThread *thread)
+{
+    UserModelPopulation population;
+    population.snapshot = UserDatabase::snapshot();
+    population.guestEnabled = population.snapshot->user((uid_t)SAILFISH_USERMANAGER_GUEST_UID) != nullptr;
+
+    const UserDatabase::Group *grp = population.snapshot->group(QStringLiteral("users"));
+    if (!grp) {
+        qCWarning(lcUsersLog) << "Could not read users group";
+        return population;
+    }
+    for (const QString &member : grp->members) {
+        const UserDatabase::User *user = population.snapshot->user(member);
+        if (!user)
+            continue;
+        // Logged in state is set when the row is inserted in the GUI thread
+        UserModelRows::User row(new UserInfoPrivate(user, false));
+        row->moveToThread(thread);
+        population.users.append(row);
+    }
+    return population;
+}
 }
 
+struct UserModelBatch
+{
+    struct Operation {
+        uint uid;
+        QString method;
+        QVariantList arguments;
+        QDBusError error;
+        uint result; // uid of added user
+    };
+
+    UserModelBatch() : depth(0), pending(0) {}
+
+    int depth;
+    QVector<Operation> queued;
+    QVector<Operation> sent;
+    int pending;
+    // Structural changes signalled while replies are pending
+    QSet<uint> added;
+    QSet<uint> removed;
+};
+
 UserModel::UserModel(QObject *parent)
     : QAbstractListModel(parent)
+    , m_users(new UserModelRows)
     , m_dBusInterface(nullptr)
     , m_dBusWatcher(new QDBusServiceWatcher(UserManagerService, QDBusConnection::systemBus(),
                     QDBusServiceWatcher::WatchForRegistration | QDBusServiceWatcher::WatchForUnregistration, this))
-    , m_guestEnabled(getpwuid((uid_t)SAILFISH_USERMANAGER_GUEST_UID))
+    , m_guestEnabled(false)
+    , m_populated(false)
+    , m_batch(new UserModelBatch)
 {
     connect(this, &UserModel::guestEnabledChanged,
             this, &UserModel::maximumCountChanged);
@@ -90,21 +143,41 @@ UserModel::UserModel(QObject *parent)
             this, &UserModel::createInterface);
     connect(m_dBusWatcher, &QDBusServiceWatcher::serviceUnregistered,
             this, &UserModel::destroyInterface);
-    if (QDBusConnection::systemBus().interface()->isServiceRegistered(UserManagerService))
-        createInterface();
-    struct group *grp = getgrnam("users");
-    if (!grp) {
-        qCWarning(lcUsersLog) << "Could not read users group:" << strerror(errno);
-    } else {
-        for (int i = 0; grp->gr_mem[i] != nullptr; ++i) {
-            UserInfo user(QString(grp->gr_mem[i]));
-            if (user.isValid()) { // Skip invalid users here
-                m_users.append(user);
-                m_uidsToRows.insert(user.uid(), m_users.count()-1);
-            }
-        }
-    }
-    // grp must not be free'd
+
+    // Check for user-managerd without blocking
+    auto call = QDBusConnection::systemBus().interface()->asyncCall(QStringLiteral("NameHasOwner"), UserManagerService);
+    auto *serviceWatcher = new QDBusPendingCallWatcher(call, this);
+    connect(serviceWatcher, &QDBusPendingCallWatcher::finished, this, [this](QDBusPendingCallWatcher *call) {
+        QDBusPendingReply<bool> reply = *call;
+        if (reply.isError())
+            qCWarning(lcUsersLog) << "Could not check for user-managerd:" << reply.error();
+        else if (reply.value())
+            createInterface();
+        call->deleteLater();
+    });
+
+    auto *databaseWatcher = UserDatabaseWatcher::instance();
+    connect(databaseWatcher, &UserDatabaseWatcher::userAdded,
+            this, &UserModel::onDatabaseUserAdded);
+    connect(databaseWatcher, &UserDatabaseWatcher::userModified,
+            this, &UserModel::onDatabaseUserModified);
+    connect(databaseWatcher, &UserDatabaseWatcher::userRemoved,
+            this, &UserModel::onUserRemoved);
+    connect(databaseWatcher, &UserDatabaseWatcher::userGroupsChanged,
+            this, &UserModel::onDatabaseUserGroupsChanged);
+    connect(SeatMonitor::instance(), &SeatMonitor::activeUidChanged,
+            this, &UserModel::onActiveUidChanged);
+    connect(UserStatistics::instance(), &UserStatistics::homeSizeChanged,
+            this, &UserModel::onHomeSizeChanged);
+    connect(UserStatistics::instance(), &UserStatistics::lastLoginChanged,
+            this, &UserModel::onLastLoginChanged);
+
+    auto *populateWatcher = new QFutureWatcher<UserModelPopulation>(this);
+    connect(populateWatcher, &QFutureWatcherBase::finished, this, [this, populateWatcher] {
+        populate(populateWatcher->result());
+        populateWatcher->deleteLater();
+    });
+    populateWatcher->setFuture(QtConcurrent::run(readUsers, thread()));
 }
 
 UserModel::~UserModel()
@@ -114,9 +187,7 @@ UserModel::~UserModel()
 bool UserModel::placeholder() const
 {
     // Placeholder is always last and the only item that can be invalid
-    if (m_users.count() == 0)
-        return false;
-    return !m_users.last().isValid();
+    return m_users->hasPlaceholder();
 }
 
 void UserModel::setPlaceholder(bool value)
@@ -125,19 +196,29 @@ void UserModel::setPlaceholder(bool value)
         return;
 
     if (value) {
-        int row = m_users.count();
+        int row = m_users->count();
         beginInsertRows(QModelIndex(), row, row);
-        m_users.append(UserInfo::placeholder());
+        m_users->setPlaceholder(UserInfo::placeholder().d_ptr);
         endInsertRows();
     } else {
-        int row = m_users.count()-1;
+        int row = m_users->count()-1;
         beginRemoveRows(QModelIndex(), row, row);
-        m_users.remove(row);
+        m_users->setPlaceholder(UserModelRows::User());
         endRemoveRows();
     }
     emit placeholderChanged();
 }
 
+/*
+ * Returns true after the users have been read
+ *
+ * The model is empty until then.
+ */
+bool UserModel::populated() const
+{
+    return m_populated;
+}
+
 /*
  * Number of existing users
  *
@@ -145,7 +226,7 @@ void UserModel::setPlaceholder(bool value)
  */
 int UserModel::count() const
 {
-    return (placeholder()) ? m_users.count()-1 : m_users.count();
+    return m_users->userCount();
 }
 
 /*
@@ -170,6 +251,9 @@ QHash<int, QByteArray> UserModel::roleNames() const
         { CurrentRole, "current" },
         { PlaceholderRole, "placeholder" },
         { TransitioningRole, "transitioning" },
+        { GroupsRole, "groups" },
+        { HomeSizeRole, "homeSize" },
+        { LastLoginRole, "lastLogin" },
     };
     return roles;
 }
@@ -177,32 +261,39 @@ QHash<int, QByteArray> UserModel::roleNames() const
 int UserModel::rowCount(const QModelIndex &parent) const
 {
     Q_UNUSED(parent)
-    return m_users.count();
+    return m_users->count();
 }
 
 QVariant UserModel::data(const QModelIndex &index, int role) const
 {
-    if (index.row() < 0 || index.row() >= m_users.count() || index.column() != 0)
+    if (index.row() < 0 || index.row() >= m_users->count() || index.column() != 0)
         return QVariant();
 
-    const UserInfo &user = m_users.at(index.row());
+    const UserModelRows::User &user = m_users->at(index.row());
     switch (role) {
     case Qt::DisplayRole:
-        return user.displayName();
+        return user->displayName();
     case UsernameRole:
-        return user.username();
+        return user->m_username;
     case NameRole:
-        return user.name();
+        return user->m_name;
     case TypeRole:
-        return user.type();
+        return user->type();
     case UidRole:
-        return user.uid();
+        return (int)user->m_uid;
     case CurrentRole:
-        return user.current();
+        return user->m_loggedIn;
     case PlaceholderRole:
-        return !user.isValid();
+        return !user->isValid();
     case TransitioningRole:
-        return m_transitioning.contains(user.uid());
+        return m_transitioning.contains(user->m_uid);
+    case GroupsRole:
+        return user->isValid() ? UserDatabase::snapshot()->groupNames(user->m_uid) : QStringList();
+    case HomeSizeRole:
+        // Computed in the background, -1 until known
+        return user->isValid() ? UserStatistics::instance()->homeSize(user->m_uid) : -1;
+    case LastLoginRole:
+        return user->isValid() ? UserStatistics::instance()->lastLogin(user->m_uid) : QDateTime();
     default:
         return QVariant();
     }
@@ -210,26 +301,28 @@ QVariant UserModel::data(const QModelIndex &index, int role) const
 
 bool UserModel::setData(const QModelIndex &index, const QVariant &value, int role)
 {
-    if (index.row() < 0 || index.row() >= m_users.count() || index.column() != 0)
+    if (index.row() < 0 || index.row() >= m_users->count() || index.column() != 0)
         return false;
 
-    UserInfo &user = m_users[index.row()];
+    const UserModelRows::User &user = m_users->at(index.row());
 
-    if (user.type() == UserInfo::Guest)
+    if (user->type() == UserInfo::Guest)
         return false;
 
     switch (role) {
     case NameRole: {
         QString name = value.toString();
-        if (name.isEmpty() || name == user.name())
+        if (name.isEmpty() || name == user->m_name)
             return false;
-        user.setName(name);
-        if (user.isValid()) {
+        user->setName(name);
+        uint uid = user->m_uid;
+        if (user->isValid() && !queueCall(uid, QStringLiteral("modifyUser"),
+                                          QVariantList() << uid << name)) {
             createInterface();
-            auto call = m_dBusInterface->asyncCall(QStringLiteral("modifyUser"), (uint)user.uid(), name);
+            auto call = m_dBusInterface->asyncCall(QStringLiteral("modifyUser"), uid, name);
             auto *watcher = new QDBusPendingCallWatcher(call, this);
             connect(watcher, &QDBusPendingCallWatcher::finished,
-                    this, std::bind(&UserModel::userModifyFinished, this, std::placeholders::_1, user.uid()));
+                    this, std::bind(&UserModel::userModifyFinished, this, std::placeholders::_1, uid));
         }
         emit dataChanged(index, index, QVector<int>() << role);
         return true;
@@ -241,6 +334,9 @@ bool UserModel::setData(const QModelIndex &index, const QVariant &value, int rol
     case CurrentRole:
     case PlaceholderRole:
     case TransitioningRole:
+    case GroupsRole:
+    case HomeSizeRole:
+    case LastLoginRole:
     default:
         return false;
     }
@@ -249,12 +345,65 @@ bool UserModel::setData(const QModelIndex &index, const QVariant &value, int rol
 QModelIndex UserModel::index(int row, int column, const QModelIndex &parent) const
 {
     Q_UNUSED(parent);
-    if (row < 0 || row >= m_users.count() || column != 0)
+    if (row < 0 || row >= m_users->count() || column != 0)
         return QModelIndex();
 
     return createIndex(row, 0, row);
 }
 
+/*
+ * Starts collecting modifications instead of sending them right away
+ *
+ * Applies to createUser, removeUser, addGroups, removeGroups and name
+ * changes. Calls can be nested, modifications are sent when the
+ * outermost batch is committed.
+ */
+void UserModel::beginBatch()
+{
+    m_batch->depth++;
+}
+
+/*
+ * Sends the collected modifications to user-managerd
+ *
+ * All calls are sent at once without waiting for replies. Rows are
+ * added and removed in one model reset after every reply has arrived,
+ * failures are then signalled as usual and batchFinished is emitted.
+ */
+void UserModel::commitBatch()
+{
+    if (m_batch->depth == 0 || --m_batch->depth > 0)
+        return;
+
+    if (m_batch->queued.isEmpty()) {
+        if (m_batch->pending == 0)
+            emit batchFinished();
+        return;
+    }
+
+    createInterface();
+    for (const UserModelBatch::Operation &operation : m_batch->queued) {
+        int i = m_batch->sent.count();
+        m_batch->sent.append(operation);
+        m_batch->pending++;
+        auto call = m_dBusInterface->asyncCallWithArgumentList(operation.method, operation.arguments);
+        auto *watcher = new QDBusPendingCallWatcher(call, this);
+        connect(watcher, &QDBusPendingCallWatcher::finished, this, [this, i](QDBusPendingCallWatcher *call) {
+            UserModelBatch::Operation &operation = m_batch->sent[i];
+            if (call->isError()) {
+                operation.error = call->error();
+            } else if (operation.method == QStringLiteral("addUser")) {
+                QDBusPendingReply<uint> reply = *call;
+                operation.result = reply.value();
+            }
+            call->deleteLater();
+            if (--m_batch->pending == 0)
+                applyBatch();
+        });
+    }
+    m_batch->queued.clear();
+}
+
 /*
  * Creates new user from a placeholder user.
  *
@@ -265,15 +414,16 @@ void UserModel::createUser()
     if (!placeholder())
         return;
 
-    auto user = m_users.last();
-    if (user.name().isEmpty())
+    auto user = m_users->placeholder();
+    if (user->m_name.isEmpty())
         return;
 
-    m_transitioning.insert(user.uid());
-    auto idx = index(m_users.count()-1, 0);
-    emit dataChanged(idx, idx, QVector<int>() << TransitioningRole);
+    m_transitioning.insert(user->m_uid);
+    rowChanged(m_users->count()-1, QVector<int>() << TransitioningRole);
+    if (queueCall(user->m_uid, QStringLiteral("addUser"), QVariantList() << user->m_name))
+        return;
     createInterface();
-    auto call = m_dBusInterface->asyncCall(QStringLiteral("addUser"), user.name());
+    auto call = m_dBusInterface->asyncCall(QStringLiteral("addUser"), user->m_name);
     auto *watcher = new QDBusPendingCallWatcher(call, this);
     connect(watcher, &QDBusPendingCallWatcher::finished,
             this, &UserModel::userAddFinished);
@@ -281,47 +431,49 @@ void UserModel::createUser()
 
 void UserModel::removeUser(int row)
 {
-    if (row < 0 || row >= m_users.count())
+    if (row < 0 || row >= m_users->count())
         return;
 
-    auto user = m_users.at(row);
-    if (!user.isValid())
+    auto user = m_users->at(row);
+    if (!user->isValid())
         return;
 
-    m_transitioning.insert(user.uid());
-    auto idx = index(row, 0);
-    emit dataChanged(idx, idx, QVector<int>() << TransitioningRole);
+    uint uid = user->m_uid;
+    m_transitioning.insert(uid);
+    rowChanged(row, QVector<int>() << TransitioningRole);
+    if (queueCall(uid, QStringLiteral("removeUser"), QVariantList() << uid))
+        return;
     createInterface();
-    auto call = m_dBusInterface->asyncCall(QStringLiteral("removeUser"), (uint)user.uid());
+    auto call = m_dBusInterface->asyncCall(QStringLiteral("removeUser"), uid);
     auto *watcher = new QDBusPendingCallWatcher(call, this);
     connect(watcher, &QDBusPendingCallWatcher::finished,
-            this, std::bind(&UserModel::userRemoveFinished, this, std::placeholders::_1, user.uid()));
+            this, std::bind(&UserModel::userRemoveFinished, this, std::placeholders::_1, uid));
 }
 
 void UserModel::setCurrentUser(int row)
 {
-    if (row < 0 || row >= m_users.count())
+    if (row < 0 || row >= m_users->count())
         return;
 
-    auto user = m_users.at(row);
-    if (!user.isValid())
+    auto user = m_users->at(row);
+    if (!user->isValid())
         return;
 
+    uint uid = user->m_uid;
     createInterface();
-    auto call = m_dBusInterface->asyncCall(QStringLiteral("setCurrentUser"), (uint)user.uid());
+    auto call = m_dBusInterface->asyncCall(QStringLiteral("setCurrentUser"), uid);
     auto *watcher = new QDBusPendingCallWatcher(call, this);
     connect(watcher, &QDBusPendingCallWatcher::finished,
-            this, std::bind(&UserModel::setCurrentUserFinished, this, std::placeholders::_1, user.uid()));
+            this, std::bind(&UserModel::setCurrentUserFinished, this, std::placeholders::_1, uid));
 }
 
 void UserModel::reset(int row)
 {
-    if (row < 0 || row >= m_users.count())
+    if (row < 0 || row >= m_users->count())
         return;
 
-    m_users[row].reset();
-    auto idx = index(row, 0);
-    emit dataChanged(idx, idx, QVector<int>());
+    m_users->at(row)->reset();
+    rowChanged(row, QVector<int>());
 }
 
 UserInfo * UserModel::getCurrentUser() const
@@ -329,114 +481,134 @@ UserInfo * UserModel::getCurrentUser() const
     return new UserInfo();
 }
 
+/*
+ * Memberships are read from /etc/passwd and /etc/group only. Unlike
+ * with the NSS lookups used before, groups from other NSS sources are
+ * not seen, but user-managerd only manages the local files anyway.
+ */
 bool UserModel::hasGroup(int row, const QString &group) const
 {
-    if (row < 0 || row >= m_users.count())
+    if (row < 0 || row >= m_users->count())
         return false;
 
-    auto user = m_users.at(row);
-    if (!user.isValid())
+    const UserModelRows::User &user = m_users->at(row);
+    if (!user->isValid())
         return false;
 
-    return sailfish_access_control_hasgroup(user.uid(), group.toUtf8().constData());
+    return UserDatabase::snapshot()->isMember(user->m_uid, group);
+}
+
+/*
+ * Returns membership of the user in each of the groups, in the same order
+ *
+ * Prefer this over calling hasGroup repeatedly for the same user.
+ */
+QVariantList UserModel::hasGroups(int row, const QStringList &groups) const
+{
+    QVariantList result;
+    result.reserve(groups.count());
+
+    bool valid = row >= 0 && row < m_users->count() && m_users->at(row)->isValid();
+    uid_t uid = valid ? m_users->at(row)->m_uid : 0;
+    auto snapshot = UserDatabase::snapshot();
+    for (const QString &group : groups)
+        result.append(valid && snapshot->isMember(uid, group));
+
+    return result;
 }
 
 void UserModel::addGroups(int row, const QStringList &groups)
 {
-    if (row < 0 || row >= m_users.count())
+    if (row < 0 || row >= m_users->count())
         return;
 
-    auto user = m_users.at(row);
-    if (!user.isValid())
+    auto user = m_users->at(row);
+    if (!user->isValid())
         return;
 
+    uint uid = user->m_uid;
+    if (queueCall(uid, QStringLiteral("addToGroups"), QVariantList() << uid << groups))
+        return;
     createInterface();
-    auto call = m_dBusInterface->asyncCall(QStringLiteral("addToGroups"), (uint)user.uid(), groups);
+    auto call = m_dBusInterface->asyncCall(QStringLiteral("addToGroups"), uid, groups);
     auto *watcher = new QDBusPendingCallWatcher(call, this);
     connect(watcher, &QDBusPendingCallWatcher::finished,
-            this, std::bind(&UserModel::addToGroupsFinished, this, std::placeholders::_1, user.uid()));
+            this, std::bind(&UserModel::addToGroupsFinished, this, std::placeholders::_1, uid));
 }
 
 void UserModel::removeGroups(int row, const QStringList &groups)
 {
-    if (row < 0 || row >= m_users.count())
+    if (row < 0 || row >= m_users->count())
         return;
 
-    auto user = m_users.at(row);
-    if (!user.isValid())
+    auto user = m_users->at(row);
+    if (!user->isValid())
         return;
 
+    uint uid = user->m_uid;
+    if (queueCall(uid, QStringLiteral("removeFromGroups"), QVariantList() << uid << groups))
+        return;
     createInterface();
-    auto call = m_dBusInterface->asyncCall(QStringLiteral("removeFromGroups"), (uint)user.uid(), groups);
+    auto call = m_dBusInterface->asyncCall(QStringLiteral("removeFromGroups"), uid, groups);
     auto *watcher = new QDBusPendingCallWatcher(call, this);
     connect(watcher, &QDBusPendingCallWatcher::finished,
-            this, std::bind(&UserModel::removeFromGroupsFinished, this, std::placeholders::_1, user.uid()));
+            this, std::bind(&UserModel::removeFromGroupsFinished, this, std::placeholders::_1, uid));
 }
 
 void UserModel::onUserAdded(const SailfishUserManagerEntry &entry)
 {
-    if (m_uidsToRows.contains(entry.uid))
+    if (m_users->contains(entry.uid))
         return;
 
     // Not found already, appending
     auto user = UserInfo(entry.uid);
     if (user.isValid())
-        add(user);
+        add(user.d_ptr);
 }
 
 void UserModel::onUserModified(uint uid, const QString &newName)
 {
-    if (!m_uidsToRows.contains(uid))
+    int row = m_users->row(uid);
+    if (row < 0)
         return;
 
-    int row = m_uidsToRows.value(uid);
-    UserInfo &user = m_users[row];
-    if (user.name() != newName) {
-        user.setName(newName);
-        auto idx = index(row, 0);
-        dataChanged(idx, idx, QVector<int>() << NameRole);
+    const UserModelRows::User &user = m_users->at(row);
+    if (user->m_name != newName) {
+        user->setName(newName);
+        rowChanged(row, QVector<int>() << NameRole);
     }
 }
 
 void UserModel::onUserRemoved(uint uid)
 {
-    if (!m_uidsToRows.contains(uid))
+    int row = m_users->row(uid);
+    if (row < 0)
+        return;
+
+    if (m_batch->pending > 0) {
+        m_batch->removed.insert(uid);
         return;
+    }
 
-    int row = m_uidsToRows.value(uid);
     beginRemoveRows(QModelIndex(), row, row);
     m_transitioning.remove(uid);
-    m_users.remove(row);
-    // It is slightly costly to remove users since some row numbers may need to be updated
-    m_uidsToRows.remove(uid);
-    for (auto iter = m_uidsToRows.begin(); iter != m_uidsToRows.end(); ++iter) {
-        if (iter.value() > row)
-            iter.value() -= 1;
-    }
+    // Later rows are not renumbered, see UserModelRows
+    m_users->remove(uid);
     endRemoveRows();
     emit countChanged();
 }
 
 void UserModel::onCurrentUserChanged(uint uid)
 {
-    UserInfo *previous = getCurrentUser();
-    if (previous) {
-        if (previous->updateCurrent()) {
-            auto idx = index(m_uidsToRows.value(previous->uid()), 0);
-            emit dataChanged(idx, idx, QVector<int>() << CurrentRole);
-        }
-        delete previous;
-    }
-    if (m_uidsToRows.contains(uid) && m_users[m_uidsToRows.value(uid)].updateCurrent()) {
-        auto idx = index(m_uidsToRows.value(uid), 0);
-        emit dataChanged(idx, idx, QVector<int>() << CurrentRole);
-    }
+    // Current user is followed from systemd-logind by onActiveUidChanged,
+    // the switch is not complete before the new user is active on seat0
+    Q_UNUSED(uid)
 }
 
 void UserModel::onCurrentUserChangeFailed(uint uid)
 {
-    if (m_uidsToRows.contains(uid)) {
-        emit setCurrentUserFailed(m_uidsToRows.value(uid), Failure);
+    if (m_users->contains(uid)) {
+        emit setCurrentUserFailed(m_users->row(uid), Failure);
     }
 }
 
@@ -448,6 +620,66 @@ void UserModel::onGuestUserEnabled(bool enabled)
     }
 }
 
+void UserModel::onDatabaseUserAdded(uint uid)
+{
+    if (m_users->contains(uid))
+        return;
+
+    // Only members of users group are listed
+    auto snapshot = UserDatabase::snapshot();
+    const UserDatabase::User *entry = snapshot->user((uid_t)uid);
+    const UserDatabase::Group *grp = snapshot->group(QStringLiteral("users"));
+    if (entry && grp && grp->members.contains(entry->username)) {
+        auto user = UserInfo(uid);
+        if (user.isValid())
+            add(user.d_ptr);
+    }
+}
+
+void UserModel::onDatabaseUserModified(uint uid)
+{
+    int row = m_users->row(uid);
+    if (row < 0)
+        return;
+
+    // A new primary group is followed by userGroupsChanged which updates GroupsRole
+    m_users->at(row)->set(UserDatabase::snapshot()->user((uid_t)uid));
+    rowChanged(row, QVector<int>() << Qt::DisplayRole << UsernameRole << NameRole);
+}
+
+void UserModel::onDatabaseUserGroupsChanged(uint uid)
+{
+    int row = m_users->row(uid);
+    if (row >= 0) {
+        rowChanged(row, QVector<int>() << GroupsRole);
+        emit userGroupsChanged(row);
+    } else {
+        onDatabaseUserAdded(uid); // May have been added to users group
+    }
+}
+
+void UserModel::onActiveUidChanged(uint uid, uint previous)
+{
+    for (uint changed : { previous, uid }) {
+        int row = m_users->row(changed);
+        if (row >= 0) {
+            // Shared data may have been updated already, make sure the row is in sync either way
+            m_users->at(row)->updateCurrent((uid_t)uid);
+            rowChanged(row, QVector<int>() << CurrentRole);
+        }
+    }
+}
+
+void UserModel::onHomeSizeChanged(uint uid)
+{
+    rowChanged(m_users->row(uid), QVector<int>() << HomeSizeRole);
+}
+
+void UserModel::onLastLoginChanged(uint uid)
+{
+    rowChanged(m_users->row(uid), QVector<int>() << LastLoginRole);
+}
+
 bool UserModel::guestEnabled() const
 {
     return m_guestEnabled;
@@ -460,8 +692,7 @@ void UserModel::setGuestEnabled(bool enabled)
 
     if (m_guestEnabled) {
         m_transitioning.insert(SAILFISH_USERMANAGER_GUEST_UID);
-        auto idx = index(m_uidsToRows.value(SAILFISH_USERMANAGER_GUEST_UID), 0);
-        emit dataChanged(idx, idx, QVector<int>() << TransitioningRole);
+        rowChanged(m_users->row(SAILFISH_USERMANAGER_GUEST_UID), QVector<int>() << TransitioningRole);
     }
     createInterface();
     auto call = m_dBusInterface->asyncCall(QStringLiteral("enableGuestUser"), enabled);
@@ -480,9 +711,9 @@ void UserModel::userAddFinished(QDBusPendingCallWatcher *call)
     } else {
         uint uid = reply.value();
         // Check that this was not just added to the list by onUserAdded
-        if (!m_uidsToRows.contains(uid)) {
+        if (!m_users->contains(uid)) {
             UserInfo user(uid);
-            add(user);
+            add(user.d_ptr);
         }
     }
     call->deleteLater();
@@ -492,7 +723,7 @@ void UserModel::userModifyFinished(QDBusPendingCallWatcher *call, uint uid)
 {
     QDBusPendingReply<void> reply = *call;
     if (reply.isError()) {
-        int row = m_uidsToRows.value(uid);
+        int row = m_users->row(uid);
         auto error = reply.error();
         emit userModifyFailed(row, getErrorType(error));
         qCWarning(lcUsersLog) << "Modifying user with usermanager failed:" << error;
@@ -505,13 +736,12 @@ void UserModel::userRemoveFinished(QDBusPendingCallWatcher *call, uint uid)
 {
     QDBusPendingReply<void> reply = *call;
     if (reply.isError()) {
-        int row = m_uidsToRows.value(uid);
+        int row = m_users->row(uid);
         auto error = reply.error();
         emit userRemoveFailed(row, getErrorType(error));
         qCWarning(lcUsersLog) << "Removing user with usermanager failed:" << error;
         m_transitioning.remove(uid);
-        auto idx = index(row, 0);
-        emit dataChanged(idx, idx, QVector<int>() << TransitioningRole);
+        rowChanged(row, QVector<int>() << TransitioningRole);
     } // else awesome! (waiting for signal to alter data)
     call->deleteLater();
 }
@@ -521,7 +751,7 @@ void UserModel::setCurrentUserFinished(QDBusPendingCallWatcher *call, uint uid)
     QDBusPendingReply<void> reply = *call;
     if (reply.isError()) {
         auto error = reply.error();
-        emit setCurrentUserFailed(m_uidsToRows.value(uid), getErrorType(error));
+        emit setCurrentUserFailed(m_users->row(uid), getErrorType(error));
         qCWarning(lcUsersLog) << "Switching user with usermanager failed:" << error;
     } // else user switching was initiated successfully
     call->deleteLater();
@@ -532,10 +762,11 @@ void UserModel::addToGroupsFinished(QDBusPendingCallWatcher *call, uint uid)
     QDBusPendingReply<void> reply = *call;
     if (reply.isError()) {
         auto error = reply.error();
-        emit addGroupsFailed(m_uidsToRows.value(uid), getErrorType(error));
+        emit addGroupsFailed(m_users->row(uid), getErrorType(error));
         qCWarning(lcUsersLog) << "Adding user to groups failed:" << error;
     } else {
-        emit userGroupsChanged(m_uidsToRows.value(uid));
+        // Emits userGroupsChanged once the new memberships can be read
+        UserDatabaseWatcher::instance()->refresh();
     }
     call->deleteLater();
 }
@@ -545,10 +776,11 @@ void UserModel::removeFromGroupsFinished(QDBusPendingCallWatcher *call, uint uid
     QDBusPendingReply<void> reply = *call;
     if (reply.isError()) {
         auto error = reply.error();
-        emit removeGroupsFailed(m_uidsToRows.value(uid), getErrorType(error));
+        emit removeGroupsFailed(m_users->row(uid), getErrorType(error));
         qCWarning(lcUsersLog) << "Adding user to groups failed:" << error;
     } else {
-        emit userGroupsChanged(m_uidsToRows.value(uid));
+        // Emits userGroupsChanged once the new memberships can be read
+        UserDatabaseWatcher::instance()->refresh();
     }
     call->deleteLater();
 }
@@ -562,8 +794,7 @@ void UserModel::enableGuestUserFinished(QDBusPendingCallWatcher *call, bool enab
         qCWarning(lcUsersLog) << ((enabling) ? "Enabling" : "Disabling") << "guest user failed:" << error;
         if (!enabling) {
             m_transitioning.remove(SAILFISH_USERMANAGER_GUEST_UID);
-            auto idx = index(m_uidsToRows.value(SAILFISH_USERMANAGER_GUEST_UID), 0);
-            emit dataChanged(idx, idx, QVector<int>() << TransitioningRole);
+            rowChanged(m_users->row(SAILFISH_USERMANAGER_GUEST_UID), QVector<int>() << TransitioningRole);
         }
     } // else wait for signals
     call->deleteLater();
@@ -599,28 +830,190 @@ void UserModel::destroyInterface() {
     }
 }
 
-void UserModel::add(UserInfo &user)
+void UserModel::populate(const UserModelPopulation &population)
+{
+    UserDatabaseWatcher::instance()->adopt(population.snapshot);
+
+    if (population.guestEnabled != m_guestEnabled) {
+        m_guestEnabled = population.guestEnabled;
+        emit guestEnabledChanged();
+    }
+
+    QVector<UserModelRows::User> users;
+    auto current = UserInfoPrivate::s_current.toStrongRef();
+    uid_t activeUid = SeatMonitor::instance()->activeUid();
+    for (const UserModelRows::User &user : population.users) {
+        // Skip users that were already added by a change signal
+        if (m_users->contains(user->m_uid))
+            continue;
+        if (current && current->m_uid == user->m_uid) {
+            users.append(current);
+        } else {
+            user->updateCurrent(activeUid);
+            users.append(user);
+        }
+    }
+
+    if (!users.isEmpty()) {
+        // Insert all rows at once, before placeholder if there is one
+        int first = m_users->userCount();
+        beginInsertRows(QModelIndex(), first, first + users.count() - 1);
+        for (const UserModelRows::User &user : users)
+            m_users->append(user->m_uid, user);
+        endInsertRows();
+        emit countChanged();
+    }
+
+    m_populated = true;
+    emit populatedChanged();
+}
+
+bool UserModel::queueCall(uint uid, const QString &method, const QVariantList &arguments)
+{
+    if (m_batch->depth == 0)
+        return false;
+
+    UserModelBatch::Operation operation;
+    operation.uid = uid;
+    operation.method = method;
+    operation.arguments = arguments;
+    operation.result = 0;
+    m_batch->queued.append(operation);
+    return true;
+}
+
+void UserModel::applyBatch()
+{
+    QVector<UserModelBatch::Operation> operations;
+    operations.swap(m_batch->sent);
+    QSet<uint> added;
+    added.swap(m_batch->added);
+    QSet<uint> removed;
+    removed.swap(m_batch->removed);
+
+    for (const UserModelBatch::Operation &operation : operations) {
+        if (operation.error.isValid())
+            continue;
+        if (operation.method == QStringLiteral("addUser"))
+            added.insert(operation.result);
+        else if (operation.method == QStringLiteral("removeUser"))
+            removed.insert(operation.uid);
+    }
+
+    QVector<UserModelRows::User> newUsers;
+    for (uint uid : added) {
+        if (!m_users->contains(uid) && !removed.contains(uid)) {
+            UserInfo user(uid);
+            if (user.isValid())
+                newUsers.append(user.d_ptr);
+        }
+    }
+    bool removing = false;
+    for (uint uid : removed)
+        removing |= m_users->contains(uid);
+
+    if (removing || !newUsers.isEmpty()) {
+        // Apply all row changes in one go
+        beginResetModel();
+        for (uint uid : removed) {
+            if (m_users->remove(uid))
+                m_transitioning.remove(uid);
+        }
+        for (const UserModelRows::User &user : newUsers) {
+            const UserModelRows::User &placeholder = m_users->placeholder();
+            if (placeholder && m_transitioning.contains(placeholder->m_uid)
+                    && placeholder->m_name == user->m_name) {
+                // This is the placeholder we were adding, free it for the next user
+                placeholder->reset();
+                m_transitioning.remove(placeholder->m_uid);
+            }
+            m_users->append(user->m_uid, user);
+            m_transitioning.remove(user->m_uid);
+        }
+        endResetModel();
+        emit countChanged();
+    }
+
+    for (const UserModelBatch::Operation &operation : operations) {
+        if (!operation.error.isValid() && (operation.method == QStringLiteral("addToGroups")
+                                           || operation.method == QStringLiteral("removeFromGroups"))) {
+            // Emits userGroupsChanged once the new memberships can be read
+            UserDatabaseWatcher::instance()->refresh();
+            break;
+        }
+    }
+
+    for (const UserModelBatch::Operation &operation : operations) {
+        QDBusError error = operation.error;
+        int row = m_users->row(operation.uid);
+        if (operation.method == QStringLiteral("addUser")) {
+            if (error.isValid()) {
+                emit userAddFailed(getErrorType(error));
+                qCWarning(lcUsersLog) << "Adding user with usermanager failed:" << error;
+            }
+        } else if (operation.method == QStringLiteral("modifyUser")) {
+            if (error.isValid()) {
+                emit userModifyFailed(row, getErrorType(error));
+                qCWarning(lcUsersLog) << "Modifying user with usermanager failed:" << error;
+                reset(row);
+            }
+        } else if (operation.method == QStringLiteral("removeUser")) {
+            if (error.isValid()) {
+                emit userRemoveFailed(row, getErrorType(error));
+                qCWarning(lcUsersLog) << "Removing user with usermanager failed:" << error;
+                m_transitioning.remove(operation.uid);
+                rowChanged(row, QVector<int>() << TransitioningRole);
+            }
+        } else if (operation.method == QStringLiteral("addToGroups")) {
+            if (error.isValid()) {
+                emit addGroupsFailed(row, getErrorType(error));
+                qCWarning(lcUsersLog) << "Adding user to groups failed:" << error;
+            }
+        } else if (operation.method == QStringLiteral("removeFromGroups")) {
+            if (error.isValid()) {
+                emit removeGroupsFailed(row, getErrorType(error));
+                qCWarning(lcUsersLog) << "Removing user from groups failed:" << error;
+            }
+        }
+    }
+
+    emit batchFinished();
+}
+
+void UserModel::add(const QSharedPointer<UserInfoPrivate> &user)
 {
-    if (placeholder() && m_transitioning.contains(m_users.last().uid())
-            && m_users.last().name() == user.name()) {
+    if (m_batch->pending > 0) {
+        // Applied together with the rest of the batch
+        m_batch->added.insert(user->m_uid);
+        return;
+    }
+
+    const UserModelRows::User &placeholder = m_users->placeholder();
+    if (placeholder && m_transitioning.contains(placeholder->m_uid)
+            && placeholder->m_name == user->m_name) {
         // This is the placeholder we were adding, "change" that
-        int row = m_users.count()-1;
-        m_users.insert(row, user);
-        m_uidsToRows.insert(user.uid(), row);
-        auto idx = index(row, 0);
-        emit dataChanged(idx, idx, QVector<int>());
+        int row = m_users->userCount();
+        m_users->append(user->m_uid, user);
+        rowChanged(row, QVector<int>());
         // And then "add" the placeholder back to its position
         beginInsertRows(QModelIndex(), row+1, row+1);
-        m_users[row+1].reset();
-        m_transitioning.remove(m_users[row+1].uid());
+        placeholder->reset();
+        m_transitioning.remove(placeholder->m_uid);
         endInsertRows();
     } else {
-        int row = placeholder() ? m_users.count() - 1 : m_users.count();
+        int row = m_users->userCount();
         beginInsertRows(QModelIndex(), row, row);
-        m_users.insert(row, user);
-        m_uidsToRows.insert(user.uid(), row);
-        m_transitioning.remove(user.uid());
+        m_users->append(user->m_uid, user);
+        m_transitioning.remove(user->m_uid);
         endInsertRows();
     }
     emit countChanged();
 }
+
+void UserModel::rowChanged(int row, const QVector<int> &roles)
+{
+    if (row >= 0) {
+        auto idx = index(row, 0);
+        emit dataChanged(idx, idx, roles);
+    }
+}
@@ -35,6 +35,7 @@
 #include <QAbstractListModel>
 #include <QDBusError>
 #include <QHash>
+#include <QScopedPointer>
 #include <QSet>
 #include <QVector>
 
@@ -45,6 +46,10 @@ class QDBusInterface;
 class QDBusPendingCallWatcher;
 class QDBusServiceWatcher;
 struct SailfishUserManagerEntry;
+struct UserModelBatch;
+class UserInfoPrivate;
+class UserModelRows;
+struct UserModelPopulation;
 
 class SYSTEMSETTINGS_EXPORT UserModel: public QAbstractListModel
 {
@@ -53,6 +58,7 @@ class SYSTEMSETTINGS_EXPORT UserModel: public QAbstractListModel
     Q_PROPERTY(int count READ count NOTIFY countChanged)
     Q_PROPERTY(int maximumCount READ maximumCount NOTIFY maximumCountChanged)
     Q_PROPERTY(bool guestEnabled READ guestEnabled WRITE setGuestEnabled NOTIFY guestEnabledChanged)
+    Q_PROPERTY(bool populated READ populated NOTIFY populatedChanged)
 
 public:
     enum Roles {
@@ -63,6 +69,9 @@ public:
         CurrentRole,
         PlaceholderRole,
         TransitioningRole,
+        GroupsRole,
+        HomeSizeRole,
+        LastLoginRole,
     };
     Q_ENUM(Roles)
 
@@ -99,6 +108,7 @@ public:
     void setPlaceholder(bool value);
     int count() const;
     int maximumCount() const;
+    bool populated() const;
 
     QHash<int, QByteArray> roleNames() const;
     int rowCount(const QModelIndex &parent = QModelIndex()) const;
@@ -106,6 +116,10 @@ public:
     bool setData(const QModelIndex &index, const QVariant &value, int role = Qt::EditRole);
     QModelIndex index(int row, int column, const QModelIndex &parent = QModelIndex()) const;
 
+    // Methods to group modifications
+    Q_INVOKABLE void beginBatch();
+    Q_INVOKABLE void commitBatch();
+
     // Methods to modify users
     Q_INVOKABLE void createUser();
     Q_INVOKABLE void removeUser(int row);
@@ -115,6 +129,7 @@ public:
 
     // Methods to modify user's groups
     Q_INVOKABLE bool hasGroup(int row, const QString &group) const;
+    Q_INVOKABLE QVariantList hasGroups(int row, const QStringList &groups) const;
     Q_INVOKABLE void addGroups(int row, const QStringList &groups);
     Q_INVOKABLE void removeGroups(int row, const QStringList &groups);
 
@@ -127,6 +142,7 @@ signals:
     void countChanged();
     void maximumCountChanged();
     void guestEnabledChanged();
+    void populatedChanged();
     void userGroupsChanged(int row);
     void userAddFailed(int error);
     void userModifyFailed(int row, int error);
@@ -135,6 +151,7 @@ signals:
     void addGroupsFailed(int row, int error);
     void removeGroupsFailed(int row, int error);
     void setGuestEnabledFailed(bool enabling, int error);
+    void batchFinished();
 
 private slots:
     void onUserAdded(const SailfishUserManagerEntry &entry);
@@ -144,6 +161,13 @@ private slots:
     void onCurrentUserChangeFailed(uint uid);
     void onGuestUserEnabled(bool enabled);
 
+    void onDatabaseUserAdded(uint uid);
+    void onDatabaseUserModified(uint uid);
+    void onDatabaseUserGroupsChanged(uint uid);
+    void onActiveUidChanged(uint uid, uint previous);
+    void onHomeSizeChanged(uint uid);
+    void onLastLoginChanged(uint uid);
+
     void userAddFinished(QDBusPendingCallWatcher *call);
     void userModifyFinished(QDBusPendingCallWatcher *call, uint uid);
     void userRemoveFinished(QDBusPendingCallWatcher *call, uint uid);
@@ -156,13 +180,18 @@ private slots:
     void destroyInterface();
 
 private:
-    void add(UserInfo &user);
+    void populate(const UserModelPopulation &population);
+    void add(const QSharedPointer<UserInfoPrivate> &user);
+    bool queueCall(uint uid, const QString &method, const QVariantList &arguments);
+    void applyBatch();
+    void rowChanged(int row, const QVector<int> &roles);
 
-    QVector<UserInfo> m_users;
-    QHash<uint, int> m_uidsToRows;
+    QScopedPointer<UserModelRows> m_users;
     QSet<uint> m_transitioning;
     QDBusInterface *m_dBusInterface;
     QDBusServiceWatcher *m_dBusWatcher;
     bool m_guestEnabled;
+    bool m_populated;
+    QScopedPointer<UserModelBatch> m_batch;
 };
 #endif /* USERMODEL_H */
@@ -0,0 +1,205 @@
+/*
+ * Copyright (C) 2020 Open Mobile Platform LLC.
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+#include "usermodelrows_p.h"
+
+UserModelRows::UserModelRows()
+    : m_tree(1, 0)
+    , m_live(0)
+{
+}
+
+/*
+ * Number of rows including placeholder
+ */
+int UserModelRows::count() const
+{
+    return m_placeholder.isNull() ? m_live : m_live + 1;
+}
+
+/*
+ * Number of rows excluding placeholder
+ */
+int UserModelRows::userCount() const
+{
+    return m_live;
+}
+
+const UserModelRows::User &UserModelRows::at(int row) const
+{
+    Q_ASSERT(row >= 0 && row < count());
+    if (row == m_live)
+        return m_placeholder;
+    return m_slots.at(slot(row)).user;
+}
+
+/*
+ * Returns uid of the user on the row, the row must not be the placeholder
+ */
+uint UserModelRows::uid(int row) const
+{
+    Q_ASSERT(row >= 0 && row < m_live);
+    return m_slots.at(slot(row)).uid;
+}
+
+/*
+ * Returns row of the user or -1 if the user is not in the model
+ */
+int UserModelRows::row(uint uid) const
+{
+    auto iter = m_uidsToSlots.constFind(uid);
+    if (iter == m_uidsToSlots.constEnd())
+        return -1;
+    return prefix(iter.value() + 1) - 1;
+}
+
+bool UserModelRows::contains(uint uid) const
+{
+    return m_uidsToSlots.contains(uid);
+}
+
+/*
+ * Adds the user after other users and before the placeholder
+ */
+void UserModelRows::append(uint uid, const User &user)
+{
+    Q_ASSERT(!contains(uid));
+    int i = m_slots.count() + 1;
+    int lowest = i & -i;
+    m_tree.append(1 + prefix(i - 1) - prefix(i - lowest));
+    m_slots.append(Slot { uid, false, user });
+    m_uidsToSlots.insert(uid, m_slots.count() - 1);
+    m_live++;
+}
+
+/*
+ * Removes the user, returns false if the user was not in the model
+ */
+bool UserModelRows::remove(uint uid)
+{
+    auto iter = m_uidsToSlots.find(uid);
+    if (iter == m_uidsToSlots.end())
+        return false;
+
+    int i = iter.value();
+    m_uidsToSlots.erase(iter);
+    m_slots[i].removed = true;
+    m_slots[i].user.clear();
+    adjust(i, -1);
+    m_live--;
+
+    int tombstones = m_slots.count() - m_live;
+    if (tombstones > m_live && tombstones > 16)
+        compact();
+    return true;
+}
+
+void UserModelRows::clear()
+{
+    m_slots.clear();
+    m_tree.fill(0, 1);
+    m_uidsToSlots.clear();
+    m_live = 0;
+}
+
+bool UserModelRows::hasPlaceholder() const
+{
+    return !m_placeholder.isNull();
+}
+
+const UserModelRows::User &UserModelRows::placeholder() const
+{
+    return m_placeholder;
+}
+
+void UserModelRows::setPlaceholder(const User &placeholder)
+{
+    m_placeholder = placeholder;
+}
+
+/*
+ * Returns the slot of the row, i.e. the live slot that has row live slots before it
+ */
+int UserModelRows::slot(int row) const
+{
+    int size = m_slots.count();
+    int step = 1;
+    while (step * 2 <= size)
+        step *= 2;
+
+    int position = 0;
+    int remaining = row + 1;
+    for (; step > 0; step /= 2) {
+        if (position + step <= size && m_tree.at(position + step) < remaining) {
+            position += step;
+            remaining -= m_tree.at(position);
+        }
+    }
+    return position;
+}
+
+/*
+ * Returns number of live slots among the first count slots
+ */
+int UserModelRows::prefix(int count) const
+{
+    int sum = 0;
+    for (int i = count; i > 0; i -= i & -i)
+        sum += m_tree.at(i);
+    return sum;
+}
+
+void UserModelRows::adjust(int slot, int delta)
+{
+    for (int i = slot + 1; i < m_tree.count(); i += i & -i)
+        m_tree[i] += delta;
+}
+
+void UserModelRows::compact()
+{
+    QVector<Slot> slots;
+    slots.reserve(m_live);
+    for (const Slot &slot : m_slots) {
+        if (!slot.removed)
+            slots.append(slot);
+    }
+    m_slots.swap(slots);
+
+    m_uidsToSlots.clear();
+    m_tree.fill(0, m_slots.count() + 1);
+    for (int i = 1; i <= m_slots.count(); ++i) {
+        m_uidsToSlots.insert(m_slots.at(i - 1).uid, i - 1);
+        m_tree[i] += 1;
+        int parent = i + (i & -i);
+        if (parent <= m_slots.count())
+            m_tree[parent] += m_tree.at(i);
+    }
+}
@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2020 Open Mobile Platform LLC.
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+#ifndef USERMODELROWS_P_H
+#define USERMODELROWS_P_H
+
+#include <QHash>
+#include <QSharedPointer>
+#include <QVector>
+
+class UserInfoPrivate;
+
+/**
+ * Row storage of UserModel
+ *
+ * Users are kept in slots that never move until compaction. Removing
+ * a user only marks its slot as a tombstone, and a Fenwick tree over
+ * the live slots maps rows to slots and slots to rows in O(log n)
+ * without renumbering anything. Tombstones are compacted away once
+ * they outnumber live users. The placeholder is kept outside of the
+ * slots as it is always the last row.
+ */
+class UserModelRows
+{
+public:
+    typedef QSharedPointer<UserInfoPrivate> User;
+
+    UserModelRows();
+
+    int count() const;
+    int userCount() const;
+    const User &at(int row) const;
+    uint uid(int row) const;
+    int row(uint uid) const;
+    bool contains(uint uid) const;
+
+    void append(uint uid, const User &user);
+    bool remove(uint uid);
+    void clear();
+
+    bool hasPlaceholder() const;
+    const User &placeholder() const;
+    void setPlaceholder(const User &placeholder);
+
+private:
+    struct Slot {
+        uint uid;
+        bool removed;
+        User user;
+    };
+
+    int slot(int row) const;
+    int prefix(int count) const;
+    void adjust(int slot, int delta);
+    void compact();
+
+    QVector<Slot> m_slots;
+    QVector<int> m_tree; // 1-based, m_tree[0] is unused
+    QHash<uint, int> m_uidsToSlots;
+    int m_live;
+    User m_placeholder;
+};
+
+#endif /* USERMODELROWS_P_H */
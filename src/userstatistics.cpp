@@ -0,0 +1,361 @@
+/*
+ * Copyright (C) 2020 Open Mobile Platform LLC.
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+#include "userstatistics_p.h"
+#include "userdatabase_p.h"
+#include "logging_p.h"
+
+#include <QCoreApplication>
+#include <QFutureWatcher>
+#include <QVector>
+#include <QtConcurrent/QtConcurrentRun>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <mntent.h>
+#include <paths.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/quota.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utmp.h>
+
+namespace {
+
+// Values older than these are refreshed when read
+const qint64 HomeSizeMaxAge = 10 * 60 * 1000; // ms
+const qint64 LastLoginMaxAge = 60 * 1000; // ms
+
+// Number of wtmp records read at once
+const int WtmpChunkSize = 64;
+
+// Maximum number of directories kept open while walking home directories
+const int MaxDirectoryDepth = 64;
+
+qint64 now()
+{
+    return QDateTime::currentMSecsSinceEpoch();
+}
+
+QString mountDevice(const QString &path)
+{
+    QString device;
+    int longest = -1;
+    FILE *mounts = setmntent("/proc/mounts", "r");
+    if (mounts) {
+        struct mntent entry;
+        char buffer[1024];
+        while (getmntent_r(mounts, &entry, buffer, sizeof(buffer))) {
+            QString dir = QString::fromUtf8(entry.mnt_dir);
+            if (dir.length() > longest
+                    && (path == dir || path.startsWith(dir.endsWith(QLatin1Char('/')) ? dir : dir + QLatin1Char('/')))) {
+                longest = dir.length();
+                device = QString::fromUtf8(entry.mnt_fsname);
+            }
+        }
+        endmntent(mounts);
+    }
+    return device;
+}
+
+DIR *openDirectory(int parent, const char *name)
+{
+    int fd = openat(parent, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd < 0)
+        return nullptr;
+    DIR *dir = fdopendir(fd);
+    if (!dir) {
+        int error = errno;
+        close(fd);
+        errno = error;
+    }
+    return dir;
+}
+
+/*
+ * Returns the size of everything below the directory or -1 if the
+ * directory itself could not be read due to missing permissions
+ *
+ * Subdirectories that can't be read are left out. The tree is walked
+ * with an explicit stack of open directories. Directories deeper than
+ * MaxDirectoryDepth are put aside and walked from their path once the
+ * stack is empty, which bounds the number of open file descriptors.
+ */
+qint64 directorySize(const char *path, dev_t device)
+{
+    QVector<DIR *> stack;
+    QVector<QByteArray> paths; // Path of each directory in stack
+    QVector<QByteArray> deferred;
+    QSet<QPair<dev_t, ino_t>> linked;
+    qint64 size = 0;
+    int skipped = 0;
+
+    DIR *root = openDirectory(AT_FDCWD, path);
+    if (!root)
+        return errno == EACCES || errno == EPERM ? -1 : 0;
+    stack.append(root);
+    paths.append(QByteArray(path));
+
+    while (!stack.isEmpty() || !deferred.isEmpty()) {
+        if (stack.isEmpty()) {
+            const QByteArray next(deferred.takeLast());
+            DIR *dir = openDirectory(AT_FDCWD, next.constData());
+            struct stat buf;
+            if (dir && fstat(dirfd(dir), &buf) == 0 && buf.st_dev == device) {
+                stack.append(dir);
+                paths.append(next);
+            } else {
+                // Unreadable, or replaced since it was seen
+                if (dir)
+                    closedir(dir);
+                ++skipped;
+            }
+            continue;
+        }
+
+        DIR *dir = stack.last();
+        struct dirent *entry = readdir(dir);
+        if (!entry) {
+            closedir(dir);
+            stack.removeLast();
+            paths.removeLast();
+            continue;
+        }
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+            continue;
+        struct stat buf;
+        if (fstatat(dirfd(dir), entry->d_name, &buf, AT_SYMLINK_NOFOLLOW) < 0 || buf.st_dev != device)
+            continue; // Stay on the same file system
+        if (!S_ISDIR(buf.st_mode) && buf.st_nlink > 1) {
+            // Count hard linked files only once
+            auto key = qMakePair(buf.st_dev, buf.st_ino);
+            if (linked.contains(key))
+                continue;
+            linked.insert(key);
+        }
+        size += (qint64)buf.st_blocks * 512;
+        if (S_ISDIR(buf.st_mode)) {
+            const QByteArray childPath(paths.last() + '/' + entry->d_name);
+            if (stack.count() >= MaxDirectoryDepth) {
+                deferred.append(childPath);
+            } else if (DIR *child = openDirectory(dirfd(dir), entry->d_name)) {
+                stack.append(child);
+                paths.append(childPath);
+            } else {
+                ++skipped;
+            }
+        }
+    }
+
+    if (skipped > 0)
+        qCDebug(lcUsersLog) << "Left out" << skipped << "unreadable directories below" << path;
+    return size;
+}
+
+}
+
+UserStatistics *UserStatistics::sharedInstance = nullptr;
+
+UserStatistics *UserStatistics::instance()
+{
+    return sharedInstance ? sharedInstance : new UserStatistics;
+}
+
+UserStatistics::UserStatistics()
+    : QObject(QCoreApplication::instance())
+    , m_lastLoginsUpdated(0)
+    , m_lastLoginsPending(false)
+{
+    Q_ASSERT(!sharedInstance);
+    sharedInstance = this;
+
+    // Walking home directories is heavy on I/O, do one at a time
+    m_pool.setMaxThreadCount(1);
+}
+
+UserStatistics::~UserStatistics()
+{
+    m_pool.clear();
+    m_pool.waitForDone();
+    sharedInstance = nullptr;
+}
+
+/**
+ * Returns disk space used by the user in bytes or -1 if it's not known
+ */
+qint64 UserStatistics::homeSize(uint uid)
+{
+    auto iter = m_sizes.constFind(uid);
+    if (iter == m_sizes.constEnd()) {
+        updateHomeSize(uid);
+        return -1;
+    }
+    if (now() - iter.value().updated > HomeSizeMaxAge)
+        updateHomeSize(uid);
+    return iter.value().bytes;
+}
+
+/**
+ * Returns last login time of the user or invalid QDateTime if it's not known
+ */
+QDateTime UserStatistics::lastLogin(uint uid)
+{
+    if (now() - m_lastLoginsUpdated > LastLoginMaxAge)
+        updateLastLogins();
+    return m_lastLogins.value(uid);
+}
+
+void UserStatistics::updateHomeSize(uint uid)
+{
+    if (m_pendingSizes.contains(uid))
+        return;
+
+    QString home;
+    {
+        auto snapshot = UserDatabase::snapshot();
+        const UserDatabase::User *user = snapshot->user((uid_t)uid);
+        if (!user || user->home.isEmpty())
+            return;
+        home = user->home;
+    }
+
+    m_pendingSizes.insert(uid);
+    auto *watcher = new QFutureWatcher<qint64>(this);
+    connect(watcher, &QFutureWatcherBase::finished, this, [this, watcher, uid] {
+        m_pendingSizes.remove(uid);
+        qint64 bytes = watcher->result();
+        auto iter = m_sizes.find(uid);
+        bool changed = iter == m_sizes.end() || iter.value().bytes != bytes;
+        m_sizes.insert(uid, Size { bytes, now() });
+        if (changed)
+            emit homeSizeChanged(uid);
+        watcher->deleteLater();
+    });
+    watcher->setFuture(QtConcurrent::run(&m_pool, &UserStatistics::calculateHomeSize, uid, home));
+}
+
+void UserStatistics::updateLastLogins()
+{
+    if (m_lastLoginsPending)
+        return;
+
+    QHash<QString, uint> users;
+    for (const UserDatabase::User &user : UserDatabase::snapshot()->users())
+        users.insert(user.username, user.uid);
+
+    m_lastLoginsPending = true;
+    auto *watcher = new QFutureWatcher<QHash<uint, QDateTime>>(this);
+    connect(watcher, &QFutureWatcherBase::finished, this, [this, watcher] {
+        m_lastLoginsPending = false;
+        m_lastLoginsUpdated = now();
+        QHash<uint, QDateTime> lastLogins = watcher->result();
+        m_lastLogins.swap(lastLogins);
+        for (auto iter = m_lastLogins.constBegin(); iter != m_lastLogins.constEnd(); ++iter) {
+            if (lastLogins.value(iter.key()) != iter.value())
+                emit lastLoginChanged(iter.key());
+        }
+        watcher->deleteLater();
+    });
+    // Reading the logs is cheap compared to walking home directories, don't queue behind them
+    watcher->setFuture(QtConcurrent::run(&UserStatistics::readLastLogins, users));
+}
+
+/**
+ * Returns disk usage of the user
+ *
+ * Uses quota information of the file system if it's available and
+ * otherwise sums up the home directory. Returns -1 if the home
+ * directory could not be read due to missing permissions.
+ */
+qint64 UserStatistics::calculateHomeSize(uint uid, const QString &home)
+{
+    QString device = mountDevice(home);
+    struct if_dqblk quota;
+    if (!device.isEmpty()
+            && quotactl(QCMD(Q_GETQUOTA, USRQUOTA), device.toUtf8().constData(), uid, (caddr_t)&quota) == 0
+            && (quota.dqb_valid & QIF_SPACE)) {
+        return (qint64)quota.dqb_curspace;
+    }
+
+    QByteArray path = home.toUtf8();
+    struct stat buf;
+    if (stat(path.constData(), &buf) < 0)
+        return errno == EACCES || errno == EPERM ? -1 : 0;
+    if (!S_ISDIR(buf.st_mode))
+        return 0;
+    qint64 size = directorySize(path.constData(), buf.st_dev);
+    return size < 0 ? -1 : (qint64)buf.st_blocks * 512 + size;
+}
+
+/**
+ * Returns the latest login time of each user from lastlog and wtmp
+ *
+ * wtmp is read a chunk at a time as it may be large.
+ */
+QHash<uint, QDateTime> UserStatistics::readLastLogins(const QHash<QString, uint> &users)
+{
+    QHash<uint, qint64> times;
+
+    int fd = open(_PATH_LASTLOG, O_RDONLY | O_CLOEXEC);
+    if (fd >= 0) {
+        // lastlog is indexed by uid
+        for (uint uid : users) {
+            struct lastlog entry;
+            if (pread(fd, &entry, sizeof(entry), (off_t)uid * sizeof(entry)) == sizeof(entry) && entry.ll_time > 0)
+                times.insert(uid, entry.ll_time);
+        }
+        close(fd);
+    }
+
+    FILE *wtmp = fopen(_PATH_WTMP, "re");
+    if (wtmp) {
+        struct utmp entries[WtmpChunkSize];
+        size_t count;
+        while ((count = fread(entries, sizeof(struct utmp), WtmpChunkSize, wtmp)) > 0) {
+            for (size_t i = 0; i < count; ++i) {
+                const struct utmp &entry = entries[i];
+                if (entry.ut_type != USER_PROCESS)
+                    continue;
+                QString username = QString::fromUtf8(entry.ut_user, strnlen(entry.ut_user, sizeof(entry.ut_user)));
+                auto user = users.constFind(username);
+                if (user != users.constEnd() && entry.ut_tv.tv_sec > times.value(user.value()))
+                    times.insert(user.value(), entry.ut_tv.tv_sec);
+            }
+        }
+        fclose(wtmp);
+    }
+
+    QHash<uint, QDateTime> lastLogins;
+    for (auto iter = times.constBegin(); iter != times.constEnd(); ++iter)
+        lastLogins.insert(iter.key(), QDateTime::fromMSecsSinceEpoch(iter.value() * 1000));
+    return lastLogins;
+}
@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2020 Open Mobile Platform LLC.
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+#ifndef USERSTATISTICS_P_H
+#define USERSTATISTICS_P_H
+
+#include <QDateTime>
+#include <QHash>
+#include <QObject>
+#include <QSet>
+#include <QThreadPool>
+
+/**
+ * Cache of per user disk usage and last login times
+ *
+ * Values are computed in the background on first use and refreshed
+ * lazily when they are read after they have become stale. Reading
+ * never blocks, unknown values are returned until the data is there.
+ */
+class UserStatistics : public QObject
+{
+    Q_OBJECT
+
+public:
+    static UserStatistics *instance();
+
+    qint64 homeSize(uint uid);
+    QDateTime lastLogin(uint uid);
+
+    static qint64 calculateHomeSize(uint uid, const QString &home);
+    static QHash<uint, QDateTime> readLastLogins(const QHash<QString, uint> &users);
+
+signals:
+    void homeSizeChanged(uint uid);
+    void lastLoginChanged(uint uid);
+
+private:
+    UserStatistics();
+    ~UserStatistics();
+
+    void updateHomeSize(uint uid);
+    void updateLastLogins();
+
+    static UserStatistics *sharedInstance;
+
+    struct Size {
+        qint64 bytes;
+        qint64 updated;
+    };
+
+    QThreadPool m_pool;
+    QHash<uint, Size> m_sizes;
+    QSet<uint> m_pendingSizes;
+    QHash<uint, QDateTime> m_lastLogins;
+    qint64 m_lastLoginsUpdated;
+    bool m_lastLoginsPending;
+};
+
+#endif /* USERSTATISTICS_P_H */
@@ -0,0 +1,1080 @@
+/*
+ * Copyright (C) 2020 Open Mobile Platform LLC.
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+#include <QCryptographicHash>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <QXmlStreamReader>
+#include <QVector>
+
+#include "logging_p.h"
+#include "vpnprovisioning_p.h"
+
+namespace {
+
+const auto indexFileName = QStringLiteral(".references");
+
+enum LineKind {
+    PlainLine,
+    CommentLine,
+    LeaderLine,
+    TrailerLine
+};
+
+// OpenVPN directives that map to connman properties
+enum Directive {
+    UnknownDirective,
+    Remote,
+    Ca,
+    Cert,
+    Key,
+    AuthUserPass,
+    Mtu,
+    TunMtu,
+    NsCertType,
+    Proto,
+    Port,
+    AskPass,
+    AuthNoCache,
+    TlsRemote,
+    Cipher,
+    Auth,
+    CompLzo,
+    RemoteCertTls
+};
+
+// Length picks the candidates, so any name is compared at most three times
+Directive directiveFor(const QStringRef &name)
+{
+    switch (name.length()) {
+    case 2:
+        if (name == QLatin1String("ca")) return Ca;
+        break;
+    case 3:
+        if (name == QLatin1String("key")) return Key;
+        if (name == QLatin1String("mtu")) return Mtu;
+        break;
+    case 4:
+        if (name == QLatin1String("cert")) return Cert;
+        if (name == QLatin1String("port")) return Port;
+        if (name == QLatin1String("auth")) return Auth;
+        break;
+    case 5:
+        if (name == QLatin1String("proto")) return Proto;
+        break;
+    case 6:
+        if (name == QLatin1String("remote")) return Remote;
+        if (name == QLatin1String("cipher")) return Cipher;
+        break;
+    case 7:
+        if (name == QLatin1String("tun-mtu")) return TunMtu;
+        if (name == QLatin1String("askpass")) return AskPass;
+        break;
+    case 8:
+        if (name == QLatin1String("comp-lzo")) return CompLzo;
+        break;
+    case 10:
+        if (name == QLatin1String("tls-remote")) return TlsRemote;
+        break;
+    case 12:
+        if (name == QLatin1String("ns-cert-type")) return NsCertType;
+        if (name == QLatin1String("auth-nocache")) return AuthNoCache;
+        break;
+    case 14:
+        if (name == QLatin1String("auth-user-pass")) return AuthUserPass;
+        break;
+    case 15:
+        if (name == QLatin1String("remote-cert-tls")) return RemoteCertTls;
+        break;
+    default:
+        break;
+    }
+    return UnknownDirective;
+}
+
+/*
+ * Classifies a line with '<' at position as an embedded content leader or trailer
+ *
+ * Same as matching ^\s*<([^/>]+)> and ^\s*</([^/>]+)>, the marker is the captured name.
+ */
+LineKind markerLine(const QStringRef &line, int position, QStringRef *marker)
+{
+    const int length = line.length();
+    LineKind kind = LeaderLine;
+    int start = position + 1;
+    if (start < length && line.at(start) == QChar('/')) {
+        kind = TrailerLine;
+        ++start;
+    }
+
+    int end = start;
+    while (end < length && line.at(end) != QChar('/') && line.at(end) != QChar('>'))
+        ++end;
+    if (end == start || end == length || line.at(end) != QChar('>'))
+        return PlainLine;
+
+    *marker = line.mid(start, end - start);
+    return kind;
+}
+
+}
+
+VpnProvisioningStore::VpnProvisioningStore(const QString &path)
+    : m_dir(path)
+    , m_dirCreated(false)
+    , m_indexDirty(false)
+{
+    loadIndex();
+}
+
+QString VpnProvisioningStore::path() const
+{
+    return m_dir.absolutePath();
+}
+
+/*
+ * Returns true if fileName refers to a file in the store
+ */
+bool VpnProvisioningStore::contains(const QString &fileName) const
+{
+    return fileName.startsWith(m_dir.absolutePath() + QLatin1Char('/'));
+}
+
+/*
+ * Stores content and returns the path of the file, or an empty string on failure
+ *
+ * The file is named after the hash of the content, an existing file with
+ * the same name already has the same content and is not rewritten.
+ */
+QString VpnProvisioningStore::store(const QByteArray &content, const QString &suffix)
+{
+    const QString fileName(QString(QCryptographicHash::hash(content, QCryptographicHash::Sha1).toHex())
+                           + QChar('.') + suffix);
+    const QString filePath(m_dir.absoluteFilePath(fileName));
+
+    QMutexLocker locker(&m_mutex);
+    if (!ensureDirectory())
+        return QString();
+
+    if (!m_fileUsers.contains(fileName))
+        m_pending.insert(fileName);
+
+    if (m_stored.contains(fileName) || QFileInfo::exists(filePath))
+        return filePath;
+
+    QFile outputFile(filePath);
+    if (!outputFile.open(QIODevice::WriteOnly | QIODevice::Truncate)
+            || outputFile.write(content) != content.size()) {
+        qCWarning(lcVpnLog) << "Unable to write VPN provisioning content file:" << filePath;
+        outputFile.remove();
+        return QString();
+    }
+
+    m_stored.insert(fileName);
+    return filePath;
+}
+
+/*
+ * Records that user, a connection path, uses files
+ *
+ * Files outside of the store are ignored. Call saveIndex to persist.
+ */
+void VpnProvisioningStore::addReferences(const QString &user, const QStringList &files)
+{
+    QMutexLocker locker(&m_mutex);
+
+    QStringList fileNames;
+    for (const QString &file : files) {
+        if (contains(file))
+            fileNames.append(file.mid(m_dir.absolutePath().length() + 1));
+    }
+    fileNames.removeDuplicates();
+    fileNames.sort();
+
+    auto it = m_userFiles.constFind(user);
+    if (it != m_userFiles.constEnd() && it.value() == fileNames)
+        return;
+
+    removeUser(user);
+    if (!fileNames.isEmpty()) {
+        for (const QString &fileName : fileNames) {
+            m_fileUsers[fileName].insert(user);
+            m_pending.remove(fileName);
+        }
+        m_userFiles.insert(user, fileNames);
+    }
+    m_indexDirty = true;
+}
+
+/*
+ * Forgets user and removes the files it was the last user of
+ */
+void VpnProvisioningStore::releaseReferences(const QString &user)
+{
+    QMutexLocker locker(&m_mutex);
+    if (!m_userFiles.contains(user))
+        return;
+
+    removeUser(user);
+    m_indexDirty = true;
+}
+
+/*
+ * Forgets all users but the given ones, e.g. connections removed while not running
+ */
+void VpnProvisioningStore::retainUsers(const QSet<QString> &users)
+{
+    QMutexLocker locker(&m_mutex);
+
+    const QStringList known = m_userFiles.keys();
+    for (const QString &user : known) {
+        if (!users.contains(user)) {
+            removeUser(user);
+            m_indexDirty = true;
+        }
+    }
+}
+
+void VpnProvisioningStore::removeUser(const QString &user)
+{
+    const QStringList fileNames = m_userFiles.take(user);
+    for (const QString &fileName : fileNames) {
+        auto it = m_fileUsers.find(fileName);
+        if (it == m_fileUsers.end())
+            continue;
+
+        it.value().remove(user);
+        if (!it.value().isEmpty()) {
+            qCInfo(lcVpnLog) << "VPN provisioning file kept, used by" << it.value().count() << "connections.";
+            continue;
+        }
+
+        m_fileUsers.erase(it);
+        if (m_pending.contains(fileName)) {
+            // Just provisioned again for a connection that is still being created
+            continue;
+        }
+
+        const QString filePath(m_dir.absoluteFilePath(fileName));
+        qCInfo(lcVpnLog) << "VPN provisioning file removed: " << filePath;
+        if (!QFile::remove(filePath) && QFileInfo::exists(filePath)) {
+            qCWarning(lcVpnLog) << "VPN provisioning file could not be removed: " << filePath;
+        }
+        m_stored.remove(fileName);
+    }
+}
+
+/*
+ * Drops files stored for connections that will not be created
+ *
+ * Files that a connection uses already are kept.
+ */
+void VpnProvisioningStore::discard(const QStringList &files)
+{
+    QMutexLocker locker(&m_mutex);
+
+    for (const QString &file : files) {
+        if (!contains(file))
+            continue;
+        const QString fileName(file.mid(m_dir.absolutePath().length() + 1));
+        m_pending.remove(fileName);
+        if (m_fileUsers.contains(fileName))
+            continue;
+
+        qCInfo(lcVpnLog) << "VPN provisioning file discarded:" << file;
+        if (!QFile::remove(file) && QFileInfo::exists(file)) {
+            qCWarning(lcVpnLog) << "VPN provisioning file could not be removed: " << file;
+        }
+        m_stored.remove(fileName);
+    }
+}
+
+/*
+ * Removes the stored files that no connection uses
+ *
+ * Files stored for connections that are still being created are kept.
+ * Those of creations that failed are removed once the store is created
+ * again, e.g. on the next start. Call only once all existing connections
+ * have been referenced.
+ */
+void VpnProvisioningStore::removeUnreferenced()
+{
+    QMutexLocker locker(&m_mutex);
+
+    // The index is a hidden file and not listed
+    const QStringList fileNames = m_dir.entryList(QDir::Files);
+    for (const QString &fileName : fileNames) {
+        if (m_fileUsers.contains(fileName) || m_pending.contains(fileName))
+            continue;
+
+        const QString filePath(m_dir.absoluteFilePath(fileName));
+        qCInfo(lcVpnLog) << "Unused VPN provisioning file removed:" << filePath;
+        if (!QFile::remove(filePath) && QFileInfo::exists(filePath)) {
+            qCWarning(lcVpnLog) << "VPN provisioning file could not be removed: " << filePath;
+        }
+        m_stored.remove(fileName);
+    }
+}
+
+/*
+ * Writes the index if it has changed
+ *
+ * Each line has a file name followed by the paths of the connections using it.
+ */
+void VpnProvisioningStore::saveIndex()
+{
+    QMutexLocker locker(&m_mutex);
+    if (!m_indexDirty || !ensureDirectory())
+        return;
+
+    QByteArray content;
+    for (auto it = m_fileUsers.constBegin(); it != m_fileUsers.constEnd(); ++it) {
+        content.append(QFile::encodeName(it.key()));
+        for (const QString &user : it.value()) {
+            content.append(' ');
+            content.append(user.toUtf8());
+        }
+        content.append('\n');
+    }
+
+    QSaveFile indexFile(m_dir.absoluteFilePath(indexFileName));
+    if (!indexFile.open(QIODevice::WriteOnly) || indexFile.write(content) != content.size() || !indexFile.commit()) {
+        qCWarning(lcVpnLog) << "Unable to write VPN provisioning index:" << indexFile.fileName();
+        return;
+    }
+    m_indexDirty = false;
+}
+
+void VpnProvisioningStore::loadIndex()
+{
+    QFile indexFile(m_dir.absoluteFilePath(indexFileName));
+    if (!indexFile.open(QIODevice::ReadOnly))
+        return;
+
+    while (!indexFile.atEnd()) {
+        const QList<QByteArray> fields = indexFile.readLine().trimmed().split(' ');
+        if (fields.count() < 2)
+            continue;
+
+        const QString fileName(QFile::decodeName(fields.at(0)));
+        for (int i = 1; i < fields.count(); ++i) {
+            const QString user(QString::fromUtf8(fields.at(i)));
+            m_fileUsers[fileName].insert(user);
+            m_userFiles[user].append(fileName);
+        }
+    }
+
+    for (auto it = m_userFiles.begin(); it != m_userFiles.end(); ++it)
+        it.value().sort();
+}
+
+bool VpnProvisioningStore::ensureDirectory()
+{
+    if (!m_dirCreated) {
+        if (!m_dir.exists() && !m_dir.mkpath(m_dir.absolutePath())) {
+            qCWarning(lcVpnLog) << "Unable to create base directory for VPN provisioning content:" << m_dir.absolutePath();
+            return false;
+        }
+        m_dirCreated = true;
+    }
+    return true;
+}
+
+namespace VpnProvisioning {
+
+QVariantMap parse(const QString &path, const QString &type, VpnProvisioningStore *store)
+{
+    QVariantMap rv;
+
+    QFile provisioningFile(path);
+    if (provisioningFile.open(QIODevice::ReadOnly)) {
+        if (type == QString("openvpn")) {
+            rv = parseOpenVpn(provisioningFile, store);
+        } else if (type == QString("wireguard")) {
+            rv = parseWireGuard(provisioningFile);
+        } else if (type == QString("vpnc")) {
+            rv = parseIpsec(provisioningFile);
+        } else if (type == QString("openconnect")) {
+            rv = parseOpenConnect(provisioningFile);
+        } else {
+            qWarning() << "Provisioning not currently supported for VPN type:" << type;
+        }
+    } else {
+        qWarning() << "Unable to open provisioning file:" << path;
+    }
+
+    return rv;
+}
+
+QVariantMap parseOpenVpn(QFile &provisioningFile, VpnProvisioningStore *store)
+{
+    QVariantMap rv;
+
+    QString embeddedMarker;
+    QString embeddedContent;
+    QStringList extraOptions;
+    QVector<QStringRef> tokens;
+
+    auto normaliseProtocol = [](const QString &proto) {
+        if (proto == QStringLiteral("tcp")) {
+            // 'tcp' is an undocumented option, which is interpreted by openvpn as 'tcp-client'
+            return QStringLiteral("tcp-client");
+        }
+        return proto;
+    };
+
+    // Arguments joined by single spaces
+    auto arguments = [&tokens]() {
+        QString joined;
+        for (int i = 1; i < tokens.count(); ++i) {
+            if (i > 1)
+                joined.append(QChar(' '));
+            joined.append(tokens.at(i));
+        }
+        return joined;
+    };
+
+    const QString content(QString::fromUtf8(provisioningFile.readAll()));
+    const int length = content.length();
+    for (int lineStart = 0; lineStart < length; ) {
+        int lineEnd = content.indexOf(QChar('\n'), lineStart);
+        const int next = lineEnd < 0 ? length : lineEnd + 1;
+        if (lineEnd < 0)
+            lineEnd = length;
+        if (lineEnd > lineStart && content.at(lineEnd - 1) == QChar('\r'))
+            --lineEnd;
+        const QStringRef line(content.midRef(lineStart, lineEnd - lineStart));
+        lineStart = next;
+
+        const QChar *begin = line.constData();
+        const QChar *end = begin + line.length();
+        const QChar *ptr = begin;
+        while (ptr != end && ptr->isSpace())
+            ++ptr;
+
+        LineKind kind = PlainLine;
+        QStringRef marker;
+        if (ptr != end) {
+            if (*ptr == QChar('#') || *ptr == QChar(';')) {
+                kind = CommentLine;
+            } else if (*ptr == QChar('<')) {
+                kind = markerLine(line, ptr - begin, &marker);
+            }
+        }
+
+        if (kind == CommentLine) {
+            // Skip
+        } else if (kind == LeaderLine) {
+            embeddedMarker = marker.toString();
+        } else if (kind == TrailerLine) {
+            if (marker != embeddedMarker) {
+                qWarning() << "Invalid embedded content:" << marker << "!=" << embeddedMarker;
+            } else {
+                if (embeddedContent.isEmpty()) {
+                    qWarning() << "Ignoring empty embedded content:" << embeddedMarker;
+                } else {
+                    if (embeddedMarker == QStringLiteral("connection")) {
+                        // Special case: not embedded content, but a <connection> structure - pass through as an extra option
+                        extraOptions.append(QStringLiteral("<connection>\n") + embeddedContent + QStringLiteral("</connection>"));
+                    } else {
+                        // Embedded content, identical blobs of different profiles share the file
+                        const QString fileName(store->store(embeddedContent.toUtf8(), embeddedMarker));
+                        if (!fileName.isEmpty()) {
+                            // Add the file to the configuration
+                            if (embeddedMarker == QStringLiteral("ca")) {
+                                rv.insert(QStringLiteral("OpenVPN.CACert"), fileName);
+                            } else if (embeddedMarker == QStringLiteral("cert")) {
+                                rv.insert(QStringLiteral("OpenVPN.Cert"), fileName);
+                            } else if (embeddedMarker == QStringLiteral("key")) {
+                                rv.insert(QStringLiteral("OpenVPN.Key"), fileName);
+                            } else {
+                                // Assume that the marker corresponds to the openvpn option, (such as 'tls-auth')
+                                extraOptions.append(embeddedMarker + QChar(' ') + fileName);
+                            }
+                        }
+                    }
+                }
+            }
+            embeddedMarker.clear();
+            embeddedContent.clear();
+        } else if (!embeddedMarker.isEmpty()) {
+            embeddedContent.append(line);
+            embeddedContent.append(QChar('\n'));
+        } else {
+            tokens.clear();
+            while (ptr != end) {
+                const QChar *tokenStart = ptr;
+                while (ptr != end && !ptr->isSpace())
+                    ++ptr;
+                tokens.append(line.mid(tokenStart - begin, ptr - tokenStart));
+                while (ptr != end && ptr->isSpace())
+                    ++ptr;
+            }
+            if (tokens.isEmpty())
+                continue;
+
+            // Find directives that become part of the connman configuration
+            const Directive directive = directiveFor(tokens.front());
+            const bool hasArguments = tokens.count() > 1;
+
+            switch (directive) {
+            case Remote:
+                // Connman supports a single remote host - if we get further instances, pass them through the config file
+                if (!rv.contains(QStringLiteral("Host"))) {
+                    if (tokens.count() > 1) {
+                        rv.insert(QStringLiteral("Host"), tokens.at(1).toString());
+                    }
+                    if (tokens.count() > 2) {
+                        rv.insert(QStringLiteral("OpenVPN.Port"), tokens.at(2).toString());
+                    }
+                    if (tokens.count() > 3) {
+                        rv.insert(QStringLiteral("OpenVPN.Proto"), normaliseProtocol(tokens.at(3).toString()));
+                    }
+                } else {
+                    extraOptions.append(line.toString());
+                }
+                break;
+            case Ca:
+            case Cert:
+            case Key:
+            case AuthUserPass:
+                if (hasArguments) {
+                    // If these file paths are not absolute, assume they are in the same directory as the provisioning file
+                    QString file(tokens.at(1).toString());
+                    if (!file.startsWith(QChar('/'))) {
+                        const QFileInfo info(provisioningFile.fileName());
+                        file = info.dir().absoluteFilePath(file);
+                    }
+                    static const char *const properties[] = {
+                        "OpenVPN.CACert", "OpenVPN.Cert", "OpenVPN.Key", "OpenVPN.AuthUserPass"
+                    };
+                    rv.insert(QLatin1String(properties[directive - Ca]), file);
+                } else if (directive == AuthUserPass) {
+                    // Preserve this option to mean ask for credentials
+                    rv.insert(QStringLiteral("OpenVPN.AuthUserPass"), QStringLiteral("-"));
+                }
+                break;
+            case Mtu:
+            case TunMtu:
+                // Connman appears to use a long obsolete form of this option...
+                if (hasArguments) {
+                    rv.insert(QStringLiteral("OpenVPN.MTU"), arguments());
+                }
+                break;
+            case NsCertType:
+                if (hasArguments) {
+                    rv.insert(QStringLiteral("OpenVPN.NSCertType"), arguments());
+                }
+                break;
+            case Proto:
+                // All values from a 'remote' directive to take precedence
+                if (hasArguments && !rv.contains(QStringLiteral("OpenVPN.Proto"))) {
+                    rv.insert(QStringLiteral("OpenVPN.Proto"), normaliseProtocol(arguments()));
+                }
+                break;
+            case Port:
+                // All values from a 'remote' directive to take precedence
+                if (hasArguments && !rv.contains(QStringLiteral("OpenVPN.Port"))) {
+                    rv.insert(QStringLiteral("OpenVPN.Port"), arguments());
+                }
+                break;
+            case AskPass:
+                rv.insert(QStringLiteral("OpenVPN.AskPass"), hasArguments ? arguments() : QString());
+                break;
+            case AuthNoCache:
+                rv.insert(QStringLiteral("OpenVPN.AuthNoCache"), QStringLiteral("true"));
+                break;
+            case TlsRemote:
+                if (hasArguments) {
+                    rv.insert(QStringLiteral("OpenVPN.TLSRemote"), arguments());
+                }
+                break;
+            case Cipher:
+                if (hasArguments) {
+                    rv.insert(QStringLiteral("OpenVPN.Cipher"), arguments());
+                }
+                break;
+            case Auth:
+                if (hasArguments) {
+                    rv.insert(QStringLiteral("OpenVPN.Auth"), arguments());
+                }
+                break;
+            case CompLzo:
+                rv.insert(QStringLiteral("OpenVPN.CompLZO"), hasArguments ? arguments() : QStringLiteral("adaptive"));
+                break;
+            case RemoteCertTls:
+                if (hasArguments) {
+                    rv.insert(QStringLiteral("OpenVPN.RemoteCertTls"), arguments());
+                }
+                break;
+            case UnknownDirective:
+                // A directive that connman does not care about - pass through to the config file
+                extraOptions.append(line.toString());
+                break;
+            }
+        }
+    }
+
+    if (!extraOptions.isEmpty()) {
+        // Write a config file to contain the extra options
+        QByteArray content;
+        foreach (const QString &line, extraOptions) {
+            content.append(line.toUtf8());
+            content.append('\n');
+        }
+
+        const QString fileName(store->store(content, QStringLiteral("conf")));
+        if (!fileName.isEmpty()) {
+            rv.insert(QStringLiteral("OpenVPN.ConfigFile"), fileName);
+        }
+    }
+
+    return rv;
+}
+
+/*
+ * Parses a wg-quick configuration
+ *
+ * Connman supports a single peer, only the first one is used.
+ */
+QVariantMap parseWireGuard(QFile &provisioningFile)
+{
+    QVariantMap rv;
+
+    enum { NoSection, InterfaceSection, PeerSection, IgnoredSection } section = NoSection;
+    bool peerSeen = false;
+
+    const QList<QByteArray> lines(provisioningFile.readAll().split('\n'));
+    for (const QByteArray &rawLine : lines) {
+        QString line(QString::fromUtf8(rawLine));
+        const int comment = line.indexOf(QChar('#'));
+        if (comment >= 0)
+            line.truncate(comment);
+        line = line.trimmed();
+        if (line.isEmpty())
+            continue;
+
+        if (line.startsWith(QChar('[')) && line.endsWith(QChar(']'))) {
+            const QString name(line.mid(1, line.length() - 2).trimmed());
+            if (name.compare(QLatin1String("Interface"), Qt::CaseInsensitive) == 0) {
+                section = InterfaceSection;
+            } else if (name.compare(QLatin1String("Peer"), Qt::CaseInsensitive) == 0 && !peerSeen) {
+                section = PeerSection;
+                peerSeen = true;
+            } else {
+                if (name.compare(QLatin1String("Peer"), Qt::CaseInsensitive) == 0)
+                    qCWarning(lcVpnLog) << "Ignoring additional WireGuard peer in:" << provisioningFile.fileName();
+                section = IgnoredSection;
+            }
+            continue;
+        }
+
+        const int separator = line.indexOf(QChar('='));
+        if (separator <= 0 || section == NoSection || section == IgnoredSection)
+            continue;
+
+        const QString key(line.left(separator).trimmed().toLower());
+        // Lists are comma separated, connman doesn't want the spaces
+        const QString value(line.mid(separator + 1).trimmed().remove(QChar(' ')));
+
+        if (section == InterfaceSection) {
+            if (key == QLatin1String("address")) {
+                rv.insert(QStringLiteral("WireGuard.Address"), value);
+            } else if (key == QLatin1String("privatekey")) {
+                rv.insert(QStringLiteral("WireGuard.PrivateKey"), value);
+            } else if (key == QLatin1String("listenport")) {
+                rv.insert(QStringLiteral("WireGuard.ListenPort"), value);
+            } else if (key == QLatin1String("dns")) {
+                rv.insert(QStringLiteral("WireGuard.DNS"), value);
+            } else {
+                qCDebug(lcVpnLog) << "Ignoring unsupported WireGuard interface option:" << key;
+            }
+        } else {
+            if (key == QLatin1String("publickey")) {
+                rv.insert(QStringLiteral("WireGuard.PublicKey"), value);
+            } else if (key == QLatin1String("presharedkey")) {
+                rv.insert(QStringLiteral("WireGuard.PresharedKey"), value);
+            } else if (key == QLatin1String("allowedips")) {
+                rv.insert(QStringLiteral("WireGuard.AllowedIPs"), value);
+            } else if (key == QLatin1String("persistentkeepalive")) {
+                rv.insert(QStringLiteral("WireGuard.PersistentKeepalive"), value);
+            } else if (key == QLatin1String("endpoint")) {
+                // host:port or [address]:port
+                const int portSeparator = value.lastIndexOf(QChar(':'));
+                const bool hasPort = portSeparator > 0 && !value.endsWith(QChar(']'));
+                QString host(hasPort ? value.left(portSeparator) : value);
+                if (host.startsWith(QChar('[')) && host.endsWith(QChar(']')))
+                    host = host.mid(1, host.length() - 2);
+                rv.insert(QStringLiteral("Host"), host);
+                if (hasPort)
+                    rv.insert(QStringLiteral("WireGuard.EndpointPort"), value.mid(portSeparator + 1));
+            } else {
+                qCDebug(lcVpnLog) << "Ignoring unsupported WireGuard peer option:" << key;
+            }
+        }
+    }
+
+    return rv;
+}
+
+namespace {
+
+// Flattens swanctl.conf sections into dotted keys, e.g. connections.office.local.auth
+QHash<QString, QString> parseSwanctl(const QByteArray &content)
+{
+    QHash<QString, QString> values;
+    QStringList sections;
+
+    const QList<QByteArray> lines(content.split('\n'));
+    for (const QByteArray &rawLine : lines) {
+        QString line(QString::fromUtf8(rawLine));
+        const int comment = line.indexOf(QChar('#'));
+        if (comment >= 0)
+            line.truncate(comment);
+        line = line.trimmed();
+
+        while (!line.isEmpty()) {
+            if (line.startsWith(QChar('}'))) {
+                if (!sections.isEmpty())
+                    sections.removeLast();
+                line = line.mid(1).trimmed();
+                continue;
+            }
+
+            const int brace = line.indexOf(QChar('{'));
+            const int separator = line.indexOf(QChar('='));
+            if (brace > 0 && (separator < 0 || brace < separator)) {
+                sections.append(line.left(brace).trimmed());
+                line = line.mid(brace + 1).trimmed();
+            } else if (separator > 0) {
+                QString value(line.mid(separator + 1).trimmed());
+                const int closing = value.indexOf(QChar('}'));
+                QString rest;
+                if (closing >= 0) {
+                    rest = value.mid(closing);
+                    value = value.left(closing).trimmed();
+                }
+                if (value.length() >= 2 && value.startsWith(QChar('"')) && value.endsWith(QChar('"')))
+                    value = value.mid(1, value.length() - 2);
+                QStringList key(sections);
+                key.append(line.left(separator).trimmed());
+                values.insert(key.join(QChar('.')), value);
+                line = rest;
+            } else {
+                break;
+            }
+        }
+    }
+
+    return values;
+}
+
+// Maps the modp group of an IKE proposal such as aes256-sha1-modp1024 to a vpnc DH group
+QString dhGroup(const QString &proposals)
+{
+    if (proposals.contains(QLatin1String("modp1536")))
+        return QStringLiteral("dh5");
+    if (proposals.contains(QLatin1String("modp1024")))
+        return QStringLiteral("dh2");
+    if (proposals.contains(QLatin1String("modp768")))
+        return QStringLiteral("dh1");
+    return QString();
+}
+
+QString ipsecIdentity(QString id)
+{
+    if (id.startsWith(QChar('@')))
+        id.remove(0, 1);
+    if (id.startsWith(QLatin1String("keyid:")))
+        id.remove(0, 6);
+    return id;
+}
+
+QVariantMap parseSwanctlConnection(const QHash<QString, QString> &values, const QString &fileName)
+{
+    QVariantMap rv;
+
+    const QLatin1String remoteAddrs("remote_addrs");
+    QString prefix;
+    for (auto it = values.constBegin(); it != values.constEnd(); ++it) {
+        if (it.key().startsWith(QLatin1String("connections.")) && it.key().endsWith(QLatin1Char('.') + QString(remoteAddrs))) {
+            const QString candidate(it.key().left(it.key().length() - remoteAddrs.size()));
+            if (prefix.isEmpty() || candidate < prefix)
+                prefix = candidate;
+        }
+    }
+    if (prefix.isEmpty()) {
+        qCWarning(lcVpnLog) << "No IPsec connection found in:" << fileName;
+        return rv;
+    }
+
+    if (values.value(prefix + QStringLiteral("version")) != QLatin1String("1")) {
+        qCWarning(lcVpnLog) << "Only IKEv1 connections can be provisioned for vpnc:" << fileName;
+        return rv;
+    }
+
+    rv.insert(QStringLiteral("Host"), values.value(prefix + QStringLiteral("remote_addrs")).section(QChar(','), 0, 0).trimmed());
+
+    // Local authentication rounds are in sections starting with local, e.g. local-xauth
+    for (auto it = values.constBegin(); it != values.constEnd(); ++it) {
+        if (!it.key().startsWith(prefix + QStringLiteral("local")))
+            continue;
+        const QString key(it.key().section(QChar('.'), -1));
+        if (key == QLatin1String("id")) {
+            rv.insert(QStringLiteral("VPNC.IPSec.ID"), ipsecIdentity(it.value()));
+        } else if (key == QLatin1String("xauth_id")) {
+            rv.insert(QStringLiteral("VPNC.Xauth.Username"), it.value());
+        } else if (key == QLatin1String("auth") && it.value() == QLatin1String("pubkey")) {
+            rv.insert(QStringLiteral("VPNC.IKE.Authmode"), QStringLiteral("hybrid"));
+        }
+    }
+    if (!rv.contains(QStringLiteral("VPNC.IKE.Authmode")))
+        rv.insert(QStringLiteral("VPNC.IKE.Authmode"), QStringLiteral("psk"));
+
+    const QString group(dhGroup(values.value(prefix + QStringLiteral("proposals"))));
+    if (!group.isEmpty())
+        rv.insert(QStringLiteral("VPNC.IKE.DHGroup"), group);
+
+    // Group secret from the secrets section
+    for (auto it = values.constBegin(); it != values.constEnd(); ++it) {
+        if (it.key().startsWith(QLatin1String("secrets.ike")) && it.key().endsWith(QLatin1String(".secret"))) {
+            rv.insert(QStringLiteral("VPNC.IPSec.Secret"), it.value());
+            break;
+        }
+    }
+
+    return rv;
+}
+
+QVariantMap parseIpsecConf(const QByteArray &content, const QString &fileName)
+{
+    QVariantMap rv;
+
+    QHash<QString, QString> defaults;
+    QHash<QString, QString> conn;
+    QString current;
+
+    // The first conn with parameters is used, one with auto=ignore is skipped as a whole
+    auto usable = [&]() {
+        return !current.isEmpty() && current != QLatin1String("%default") && !conn.isEmpty()
+                && conn.value(QStringLiteral("auto"), defaults.value(QStringLiteral("auto"))) != QLatin1String("ignore");
+    };
+
+    const QList<QByteArray> lines(content.split('\n'));
+    for (const QByteArray &rawLine : lines) {
+        QString line(QString::fromUtf8(rawLine));
+        const int comment = line.indexOf(QChar('#'));
+        if (comment >= 0)
+            line.truncate(comment);
+        if (line.trimmed().isEmpty())
+            continue;
+
+        if (!line.at(0).isSpace()) {
+            // Section header, parameters are indented
+            if (usable())
+                break;
+            conn.clear();
+            const QStringList words(line.simplified().split(QChar(' ')));
+            current = words.count() == 2 && words.at(0) == QLatin1String("conn") ? words.at(1) : QString();
+            continue;
+        }
+
+        const int separator = line.indexOf(QChar('='));
+        if (current.isEmpty() || separator < 0)
+            continue;
+
+        QString value(line.mid(separator + 1).trimmed());
+        if (value.length() >= 2 && value.startsWith(QChar('"')) && value.endsWith(QChar('"')))
+            value = value.mid(1, value.length() - 2);
+        const QString key(line.left(separator).trimmed());
+
+        if (current == QLatin1String("%default")) {
+            defaults.insert(key, value);
+        } else {
+            conn.insert(key, value);
+        }
+    }
+
+    if (!usable()) {
+        qCWarning(lcVpnLog) << "No IPsec connection found in:" << fileName;
+        return rv;
+    }
+    for (auto it = defaults.constBegin(); it != defaults.constEnd(); ++it) {
+        if (!conn.contains(it.key()))
+            conn.insert(it.key(), it.value());
+    }
+
+    if (conn.value(QStringLiteral("keyexchange"), QStringLiteral("ikev1")) != QLatin1String("ikev1")) {
+        qCWarning(lcVpnLog) << "Only IKEv1 connections can be provisioned for vpnc:" << fileName;
+        return rv;
+    }
+
+    rv.insert(QStringLiteral("Host"), conn.value(QStringLiteral("right")));
+    if (conn.contains(QStringLiteral("leftid")))
+        rv.insert(QStringLiteral("VPNC.IPSec.ID"), ipsecIdentity(conn.value(QStringLiteral("leftid"))));
+    const QString xauthIdentity(conn.value(QStringLiteral("xauth_identity"), conn.value(QStringLiteral("leftxauthusername"))));
+    if (!xauthIdentity.isEmpty())
+        rv.insert(QStringLiteral("VPNC.Xauth.Username"), xauthIdentity);
+    const QString authMode(conn.value(QStringLiteral("leftauth")) == QLatin1String("pubkey")
+                           || conn.value(QStringLiteral("authby")) == QLatin1String("xauthrsasig") ? QStringLiteral("hybrid") : QStringLiteral("psk"));
+    rv.insert(QStringLiteral("VPNC.IKE.Authmode"), authMode);
+    const QString group(dhGroup(conn.value(QStringLiteral("ike"))));
+    if (!group.isEmpty())
+        rv.insert(QStringLiteral("VPNC.IKE.DHGroup"), group);
+    if (conn.value(QStringLiteral("pfs")) == QLatin1String("no"))
+        rv.insert(QStringLiteral("VPNC.PFS"), QStringLiteral("nopfs"));
+
+    // The group secret lives in ipsec.secrets next to ipsec.conf, if provided
+    QFile secrets(QFileInfo(fileName).dir().absoluteFilePath(QStringLiteral("ipsec.secrets")));
+    if (secrets.open(QIODevice::ReadOnly)) {
+        const QList<QByteArray> secretLines(secrets.readAll().split('\n'));
+        for (const QByteArray &rawLine : secretLines) {
+            const QString line(QString::fromUtf8(rawLine).trimmed());
+            const int psk = line.indexOf(QLatin1String(": PSK "));
+            if (psk >= 0) {
+                QString secret(line.mid(psk + 6).trimmed());
+                if (secret.length() >= 2 && secret.startsWith(QChar('"')) && secret.endsWith(QChar('"')))
+                    secret = secret.mid(1, secret.length() - 2);
+                rv.insert(QStringLiteral("VPNC.IPSec.Secret"), secret);
+                break;
+            }
+        }
+    }
+
+    return rv;
+}
+
+}
+
+/*
+ * Parses an IKEv1 connection from ipsec.conf or swanctl.conf into vpnc properties
+ *
+ * Connman has no strongSwan plugin, so only Cisco style IKEv1 connections
+ * (group PSK with XAuth, or hybrid) that vpnc can handle are supported.
+ * The first connection in the file is used.
+ */
+QVariantMap parseIpsec(QFile &provisioningFile)
+{
+    const QByteArray content(provisioningFile.readAll());
+    if (content.contains("connections") && content.contains('{')) {
+        return parseSwanctlConnection(parseSwanctl(content), provisioningFile.fileName());
+    }
+    return parseIpsecConf(content, provisioningFile.fileName());
+}
+
+/*
+ * Parses an AnyConnect profile, the first server of the server list is used
+ */
+QVariantMap parseOpenConnect(QFile &provisioningFile)
+{
+    QVariantMap rv;
+
+    QXmlStreamReader reader(&provisioningFile);
+    bool inHostEntry = false;
+    QString hostAddress;
+    QString hostName;
+    QString userGroup;
+
+    while (!reader.atEnd() && !reader.hasError()) {
+        reader.readNext();
+        if (reader.isStartElement()) {
+            const QStringRef name(reader.name());
+            if (name == QLatin1String("HostEntry")) {
+                inHostEntry = true;
+            } else if (inHostEntry && name == QLatin1String("HostAddress")) {
+                hostAddress = reader.readElementText().trimmed();
+            } else if (inHostEntry && name == QLatin1String("HostName")) {
+                hostName = reader.readElementText().trimmed();
+            } else if (inHostEntry && name == QLatin1String("UserGroup")) {
+                userGroup = reader.readElementText().trimmed();
+            }
+        } else if (reader.isEndElement() && reader.name() == QLatin1String("HostEntry")) {
+            break;
+        }
+    }
+
+    if (reader.hasError()) {
+        qCWarning(lcVpnLog) << "Unable to parse OpenConnect profile:" << provisioningFile.fileName() << reader.errorString();
+        return rv;
+    }
+
+    // HostAddress may be left out if HostName resolves, either may carry a /group suffix
+    QString host(hostAddress.isEmpty() ? hostName : hostAddress);
+    const int groupSeparator = host.indexOf(QChar('/'));
+    if (groupSeparator > 0) {
+        if (userGroup.isEmpty())
+            userGroup = host.mid(groupSeparator + 1);
+        host.truncate(groupSeparator);
+    }
+    if (host.isEmpty()) {
+        qCWarning(lcVpnLog) << "No server found in OpenConnect profile:" << provisioningFile.fileName();
+        return rv;
+    }
+
+    rv.insert(QStringLiteral("Host"), host);
+    rv.insert(QStringLiteral("OpenConnect.Protocol"), QStringLiteral("anyconnect"));
+    if (!userGroup.isEmpty())
+        rv.insert(QStringLiteral("OpenConnect.Usergroup"), userGroup);
+
+    return rv;
+}
+
+/*
+ * Returns the provisioning files of type in path
+ *
+ * Path can be a single file or a directory of them.
+ */
+QStringList provisioningFiles(const QString &path, const QString &type)
+{
+    const QFileInfo info(path);
+    if (!info.isDir())
+        return info.isFile() ? QStringList(info.absoluteFilePath()) : QStringList();
+
+    QStringList nameFilters;
+    if (type == QStringLiteral("openvpn")) {
+        nameFilters << QStringLiteral("*.ovpn") << QStringLiteral("*.conf");
+    } else if (type == QStringLiteral("wireguard") || type == QStringLiteral("vpnc")) {
+        nameFilters << QStringLiteral("*.conf");
+    } else if (type == QStringLiteral("openconnect")) {
+        nameFilters << QStringLiteral("*.xml");
+    }
+
+    QStringList files;
+    const QDir dir(info.absoluteFilePath());
+    for (const QString &name : dir.entryList(nameFilters, QDir::Files | QDir::Readable, QDir::Name)) {
+        files.append(dir.absoluteFilePath(name));
+    }
+    return files;
+}
+
+}
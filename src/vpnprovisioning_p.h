@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2020 Open Mobile Platform LLC.
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+#ifndef VPNPROVISIONING_P_H
+#define VPNPROVISIONING_P_H
+
+#include <QDir>
+#include <QHash>
+#include <QMutex>
+#include <QSet>
+#include <QString>
+#include <QVariantMap>
+
+class QFile;
+
+/**
+ * Content addressed storage for files extracted from provisioning files
+ *
+ * Files are named by the hash of their content, so identical embedded
+ * certificates and keys from different profiles end up in the same
+ * file and are written only once. Safe to use from several threads.
+ *
+ * The store also keeps a persistent index of the connections using
+ * each file, so that a file can be removed as soon as its last user
+ * is gone without looking at the other connections.
+ */
+class VpnProvisioningStore
+{
+public:
+    explicit VpnProvisioningStore(const QString &path);
+
+    QString path() const;
+    bool contains(const QString &fileName) const;
+
+    QString store(const QByteArray &content, const QString &suffix);
+
+    void addReferences(const QString &user, const QStringList &files);
+    void releaseReferences(const QString &user);
+    void retainUsers(const QSet<QString> &users);
+    void removeUnreferenced();
+    void discard(const QStringList &files);
+    void saveIndex();
+
+private:
+    bool ensureDirectory();
+    void loadIndex();
+    void removeUser(const QString &user);
+
+    QDir m_dir;
+    mutable QMutex m_mutex;
+    bool m_dirCreated;
+    QSet<QString> m_stored;
+    // Stored but not referenced by any connection yet, must not be removed
+    QSet<QString> m_pending;
+    QHash<QString, QSet<QString>> m_fileUsers;
+    QHash<QString, QStringList> m_userFiles;
+    bool m_indexDirty;
+};
+
+namespace VpnProvisioning {
+
+struct Result
+{
+    QString path;
+    QString type;
+    QVariantMap properties;
+};
+
+QVariantMap parse(const QString &path, const QString &type, VpnProvisioningStore *store);
+QVariantMap parseOpenVpn(QFile &provisioningFile, VpnProvisioningStore *store);
+QVariantMap parseWireGuard(QFile &provisioningFile);
+QVariantMap parseIpsec(QFile &provisioningFile);
+QVariantMap parseOpenConnect(QFile &provisioningFile);
+
+QStringList provisioningFiles(const QString &path, const QString &type);
+
+}
+
+#endif /* VPNPROVISIONING_P_H */
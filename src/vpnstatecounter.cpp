@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2020 Open Mobile Platform LLC.
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+#include "vpnstatecounter_p.h"
+
+/*
+ * Records the current state of the connection and returns the best state
+ */
+VpnConnection::ConnectionState VpnStateCounter::update(const VpnConnection *conn, VpnConnection::ConnectionState state)
+{
+    auto it = m_states.find(conn);
+    if (it != m_states.end()) {
+        if (it.value() == state)
+            return bestState();
+        --m_counts[it.value()];
+        it.value() = state;
+    } else {
+        m_states.insert(conn, state);
+    }
+    ++m_counts[state];
+    return bestState();
+}
+
+/*
+ * Forgets the connection and returns the best state of the rest
+ */
+VpnConnection::ConnectionState VpnStateCounter::remove(const VpnConnection *conn)
+{
+    auto it = m_states.find(conn);
+    if (it != m_states.end()) {
+        --m_counts[it.value()];
+        m_states.erase(it);
+    }
+    return bestState();
+}
+
+void VpnStateCounter::clear()
+{
+    m_states.clear();
+    m_counts.clear();
+}
+
+VpnConnection::ConnectionState VpnStateCounter::bestState() const
+{
+    if (m_counts.value(VpnConnection::Ready) > 0)
+        return VpnConnection::Ready;
+    if (m_counts.value(VpnConnection::Configuration) > 0)
+        return VpnConnection::Configuration;
+    return VpnConnection::Idle;
+}
@@ -0,0 +1,219 @@
+/*
+ * Copyright (C) 2020 Open Mobile Platform LLC.
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+#include <net/if.h>
+
+#include <QFile>
+
+#include "logging_p.h"
+#include "vpnstatistics_p.h"
+
+namespace {
+
+bool readCounter(const QByteArray &path, quint64 *value)
+{
+    QFile file(QString::fromLatin1(path));
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    bool ok = false;
+    *value = file.readAll().trimmed().toULongLong(&ok);
+    return ok;
+}
+
+}
+
+VpnStatistics::VpnStatistics()
+    : m_timeToReady(-1)
+    , m_rxBase(0)
+    , m_txBase(0)
+    , m_rx(0)
+    , m_tx(0)
+    , m_next(0)
+{
+}
+
+/*
+ * Starts timing an activation, called when the connection starts connecting
+ */
+void VpnStatistics::activationStarted()
+{
+    if (!m_activation.isValid())
+        m_activation.start();
+}
+
+/*
+ * Records the time it took to get ready and starts sampling interface
+ *
+ * May be called again when the interface changes, the totals restart then.
+ */
+void VpnStatistics::ready(int interfaceIndex)
+{
+    if (m_activation.isValid()) {
+        m_timeToReady = m_activation.elapsed();
+        m_activation.invalidate();
+    }
+
+    char name[IF_NAMESIZE];
+    if (interfaceIndex < 0) {
+        // Called again once the index is known
+        qCDebug(lcVpnLog) << "VPN interface not known yet, not collecting statistics";
+        m_interface.clear();
+        return;
+    }
+    if (!if_indextoname(interfaceIndex, name)) {
+        qCWarning(lcVpnLog) << "Unknown VPN interface, not collecting statistics:" << interfaceIndex;
+        m_interface.clear();
+        return;
+    }
+
+    m_interface = QByteArray(name);
+    m_rxRates.clear();
+    m_txRates.clear();
+    m_next = 0;
+    if (!readCounters(m_interface, &m_rxBase, &m_txBase)) {
+        m_interface.clear();
+        return;
+    }
+    m_rx = m_rxBase;
+    m_tx = m_txBase;
+    m_lastSample.start();
+}
+
+void VpnStatistics::stopped()
+{
+    m_activation.invalidate();
+    m_interface.clear();
+}
+
+bool VpnStatistics::isSampling() const
+{
+    return !m_interface.isEmpty();
+}
+
+/*
+ * Reads the counters and adds a rate sample, returns false if nothing was read
+ */
+bool VpnStatistics::sample()
+{
+    quint64 rx;
+    quint64 tx;
+    if (!isSampling() || !readCounters(m_interface, &rx, &tx))
+        return false;
+
+    const qint64 elapsed = m_lastSample.restart();
+    if (elapsed <= 0)
+        return false;
+
+    // Counters may reset if the interface is recreated under us
+    const qint64 rxRate = rx >= m_rx ? qint64((rx - m_rx) * 1000 / elapsed) : 0;
+    const qint64 txRate = tx >= m_tx ? qint64((tx - m_tx) * 1000 / elapsed) : 0;
+    if (rx < m_rxBase)
+        m_rxBase = rx;
+    if (tx < m_txBase)
+        m_txBase = tx;
+    m_rx = rx;
+    m_tx = tx;
+
+    if (m_rxRates.count() < WindowSize) {
+        m_rxRates.append(rxRate);
+        m_txRates.append(txRate);
+    } else {
+        m_rxRates[m_next] = rxRate;
+        m_txRates[m_next] = txRate;
+        m_next = (m_next + 1) % WindowSize;
+    }
+    return true;
+}
+
+/*
+ * Milliseconds from activation to ready of the latest activation, -1 if unknown
+ */
+qint64 VpnStatistics::timeToReady() const
+{
+    return m_timeToReady;
+}
+
+quint64 VpnStatistics::rxBytes() const
+{
+    return m_rx - m_rxBase;
+}
+
+quint64 VpnStatistics::txBytes() const
+{
+    return m_tx - m_txBase;
+}
+
+/*
+ * Average bytes per second over the window
+ */
+qint64 VpnStatistics::rxRate() const
+{
+    qint64 sum = 0;
+    for (qint64 rate : m_rxRates)
+        sum += rate;
+    return m_rxRates.isEmpty() ? 0 : sum / m_rxRates.count();
+}
+
+qint64 VpnStatistics::txRate() const
+{
+    qint64 sum = 0;
+    for (qint64 rate : m_txRates)
+        sum += rate;
+    return m_txRates.isEmpty() ? 0 : sum / m_txRates.count();
+}
+
+/*
+ * Bytes per second of each sample in the window, oldest first
+ */
+QVariantList VpnStatistics::rxHistory() const
+{
+    QVariantList history;
+    history.reserve(m_rxRates.count());
+    for (int i = 0; i < m_rxRates.count(); ++i)
+        history.append(m_rxRates.at((m_next + i) % m_rxRates.count()));
+    return history;
+}
+
+QVariantList VpnStatistics::txHistory() const
+{
+    QVariantList history;
+    history.reserve(m_txRates.count());
+    for (int i = 0; i < m_txRates.count(); ++i)
+        history.append(m_txRates.at((m_next + i) % m_txRates.count()));
+    return history;
+}
+
+bool VpnStatistics::readCounters(const QByteArray &interface, quint64 *rx, quint64 *tx)
+{
+    const QByteArray path("/sys/class/net/" + interface + "/statistics/");
+    return readCounter(path + "rx_bytes", rx) && readCounter(path + "tx_bytes", tx);
+}
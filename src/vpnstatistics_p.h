@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2020 Open Mobile Platform LLC.
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+#ifndef VPNSTATISTICS_P_H
+#define VPNSTATISTICS_P_H
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QVariant>
+#include <QVector>
+
+/**
+ * Traffic statistics of one VPN connection
+ *
+ * Counters of the tunnel interface are read from sysfs while the
+ * connection is ready. Rates are kept for a rolling window of the
+ * most recent samples.
+ */
+class VpnStatistics
+{
+public:
+    enum {
+        SampleInterval = 2000, // ms
+        WindowSize = 30
+    };
+
+    VpnStatistics();
+
+    void activationStarted();
+    void ready(int interfaceIndex);
+    void stopped();
+
+    bool isSampling() const;
+    bool sample();
+
+    qint64 timeToReady() const;
+    quint64 rxBytes() const;
+    quint64 txBytes() const;
+    qint64 rxRate() const;
+    qint64 txRate() const;
+    QVariantList rxHistory() const;
+    QVariantList txHistory() const;
+
+private:
+    static bool readCounters(const QByteArray &interface, quint64 *rx, quint64 *tx);
+
+    QElapsedTimer m_activation;
+    qint64 m_timeToReady;
+    QByteArray m_interface;
+    QElapsedTimer m_lastSample;
+    quint64 m_rxBase;
+    quint64 m_txBase;
+    quint64 m_rx;
+    quint64 m_tx;
+    // Ring buffers of bytes per second, m_next is the oldest entry once full
+    QVector<qint64> m_rxRates;
+    QVector<qint64> m_txRates;
+    int m_next;
+};
+
+#endif /* VPNSTATISTICS_P_H */
@@ -0,0 +1,27 @@
+# based on tests.pro from libprofile-qt
+
+PACKAGENAME = nemo-qml-plugin-systemsettings
+
+QT += testlib qml dbus systeminfo
+QT -= gui
+
+TEMPLATE = app
+
+target.path = $$[QT_INSTALL_LIBS]/$${PACKAGENAME}-tests
+
+contains(cov, true) {
+    message("Coverage options enabled")
+    QMAKE_CXXFLAGS += --coverage
+    QMAKE_LFLAGS += --coverage
+}
+
+CONFIG += link_prl c++11
+DEFINES += UNIT_TEST
+QMAKE_EXTRA_TARGETS = check
+
+check.depends = $$TARGET
+check.commands = LD_LIBRARY_PATH=../../lib ./$$TARGET
+
+INCLUDEPATH += ../src/
+
+INSTALLS += target
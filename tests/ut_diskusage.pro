@@ -0,0 +1,10 @@
+TARGET = ut_diskusage
+
+include(tests.pri)
+
+SOURCES += ut_diskusage.cpp
+HEADERS += ut_diskusage.h
+
+SOURCES += ../src/diskusage.cpp
+HEADERS += ../src/diskusage.h
+HEADERS += ../src/diskusage_p.h
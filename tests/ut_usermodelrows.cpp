@@ -0,0 +1,231 @@
+/*
+ * Copyright (C) 2020 Open Mobile Platform LLC.
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+#include "usermodelrows_p.h"
+
+#include "ut_usermodelrows.h"
+
+#include <QVector>
+#include <QtTest>
+
+namespace {
+
+/* Only the uids are compared, the shared user data is left empty */
+void verifyRows(const UserModelRows &rows, const QVector<uint> &expected)
+{
+    QCOMPARE(rows.userCount(), expected.count());
+    QCOMPARE(rows.count(), expected.count());
+    for (int row = 0; row < expected.count(); ++row) {
+        QCOMPARE(rows.uid(row), expected.at(row));
+        QCOMPARE(rows.row(expected.at(row)), row);
+        QVERIFY(rows.contains(expected.at(row)));
+    }
+}
+
+}
+
+void Ut_UserModelRows::testAppend()
+{
+    UserModelRows rows;
+    QVector<uint> expected;
+
+    verifyRows(rows, expected);
+    QCOMPARE(rows.row(100000), -1);
+
+    for (uint uid = 100000; uid < 100005; ++uid) {
+        rows.append(uid, UserModelRows::User());
+        expected.append(uid);
+        verifyRows(rows, expected);
+    }
+    QVERIFY(!rows.contains(100005));
+    QCOMPARE(rows.row(100005), -1);
+}
+
+void Ut_UserModelRows::testRemove()
+{
+    UserModelRows rows;
+    QVector<uint> expected;
+    for (uint uid = 100000; uid < 100008; ++uid) {
+        rows.append(uid, UserModelRows::User());
+        expected.append(uid);
+    }
+
+    // Later rows move up without being renumbered one by one
+    QVERIFY(rows.remove(100003));
+    expected.removeOne(100003);
+    verifyRows(rows, expected);
+    QVERIFY(!rows.contains(100003));
+    QCOMPARE(rows.row(100003), -1);
+
+    QVERIFY(rows.remove(100000));
+    expected.removeOne(100000);
+    QVERIFY(rows.remove(100007));
+    expected.removeOne(100007);
+    verifyRows(rows, expected);
+
+    // Removing again or removing an unknown user changes nothing
+    QVERIFY(!rows.remove(100003));
+    QVERIFY(!rows.remove(200000));
+    verifyRows(rows, expected);
+
+    // A removed user can come back, it is added last
+    rows.append(100003, UserModelRows::User());
+    expected.append(100003);
+    verifyRows(rows, expected);
+}
+
+void Ut_UserModelRows::testTombstones()
+{
+    UserModelRows rows;
+    QVector<uint> expected;
+    for (uint uid = 100000; uid < 100040; ++uid) {
+        rows.append(uid, UserModelRows::User());
+        expected.append(uid);
+    }
+
+    // Every other user goes away, tombstones stay until they outnumber live users
+    for (uint uid = 100000; uid < 100040; uid += 2) {
+        QVERIFY(rows.remove(uid));
+        expected.removeOne(uid);
+        verifyRows(rows, expected);
+    }
+
+    // Appending after tombstones keeps the order
+    for (uint uid = 100040; uid < 100045; ++uid) {
+        rows.append(uid, UserModelRows::User());
+        expected.append(uid);
+        verifyRows(rows, expected);
+    }
+}
+
+void Ut_UserModelRows::testCompaction()
+{
+    UserModelRows rows;
+    QVector<uint> expected;
+    for (uint uid = 100000; uid < 100100; ++uid) {
+        rows.append(uid, UserModelRows::User());
+        expected.append(uid);
+    }
+
+    // Removing from the front compacts once tombstones outnumber live users
+    for (uint uid = 100000; uid < 100090; ++uid) {
+        QVERIFY(rows.remove(uid));
+        expected.removeOne(uid);
+        verifyRows(rows, expected);
+    }
+
+    for (uint uid = 100100; uid < 100120; ++uid) {
+        rows.append(uid, UserModelRows::User());
+        expected.append(uid);
+    }
+    verifyRows(rows, expected);
+
+    // Down to nothing and back
+    for (uint uid : QVector<uint>(expected)) {
+        QVERIFY(rows.remove(uid));
+        expected.removeOne(uid);
+    }
+    verifyRows(rows, expected);
+    rows.append(100000, UserModelRows::User());
+    expected.append(100000);
+    verifyRows(rows, expected);
+}
+
+void Ut_UserModelRows::testRandomOperations()
+{
+    UserModelRows rows;
+    QVector<uint> expected;
+    uint nextUid = 100000;
+
+    qsrand(1234);
+    for (int i = 0; i < 5000; ++i) {
+        if (expected.isEmpty() || qrand() % 3 != 0) {
+            rows.append(nextUid, UserModelRows::User());
+            expected.append(nextUid++);
+        } else {
+            const uint uid = expected.at(qrand() % expected.count());
+            QVERIFY(rows.remove(uid));
+            expected.removeOne(uid);
+        }
+        if (i % 100 == 0)
+            verifyRows(rows, expected);
+    }
+    verifyRows(rows, expected);
+
+    while (!expected.isEmpty()) {
+        const uint uid = expected.at(qrand() % expected.count());
+        QVERIFY(rows.remove(uid));
+        expected.removeOne(uid);
+        if (expected.count() % 50 == 0)
+            verifyRows(rows, expected);
+    }
+}
+
+void Ut_UserModelRows::testClear()
+{
+    UserModelRows rows;
+    for (uint uid = 100000; uid < 100010; ++uid)
+        rows.append(uid, UserModelRows::User());
+    rows.remove(100004);
+
+    rows.clear();
+    verifyRows(rows, QVector<uint>());
+    QCOMPARE(rows.row(100000), -1);
+
+    rows.append(100004, UserModelRows::User());
+    rows.append(100000, UserModelRows::User());
+    verifyRows(rows, QVector<uint>() << 100004 << 100000);
+}
+
+void Ut_UserModelRows::benchmarkRows()
+{
+    // Hundreds of accounts as on a shared kiosk or lab device
+    const uint userCount = 500;
+
+    QBENCHMARK {
+        UserModelRows rows;
+        for (uint uid = 100000; uid < 100000 + userCount; ++uid)
+            rows.append(uid, UserModelRows::User());
+
+        // What a view does while scrolling through, and what change signals need
+        int found = 0;
+        for (int row = 0; row < rows.userCount(); ++row)
+            found += rows.row(rows.uid(row)) == row;
+        QCOMPARE(found, rows.userCount());
+
+        // Accounts going away one by one from the front, the worst case of renumbering
+        for (uint uid = 100000; uid < 100000 + userCount / 2; ++uid)
+            rows.remove(uid);
+        QCOMPARE(rows.row(100000 + userCount - 1), int(userCount / 2) - 1);
+    }
+}
+
+QTEST_APPLESS_MAIN(Ut_UserModelRows)
@@ -0,0 +1,9 @@
+TARGET = ut_usermodelrows
+
+include(tests.pri)
+
+SOURCES += ut_usermodelrows.cpp
+HEADERS += ut_usermodelrows.h
+
+SOURCES += ../src/usermodelrows.cpp
+HEADERS += ../src/usermodelrows_p.h
@@ -0,0 +1,11 @@
+TARGET = ut_vpnprovisioning
+
+include(tests.pri)
+
+SOURCES += ut_vpnprovisioning.cpp
+HEADERS += ut_vpnprovisioning.h
+
+SOURCES += ../src/logging.cpp
+SOURCES += ../src/vpnprovisioning.cpp
+HEADERS += ../src/logging_p.h
+HEADERS += ../src/vpnprovisioning_p.h
@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2020 Open Mobile Platform LLC.
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+#include "vpnstatecounter_p.h"
+
+#include "ut_vpnstatecounter.h"
+
+#include <QtTest>
+
+/* Only the addresses are used as keys, the connections are never dereferenced */
+#define CONNECTION(n) reinterpret_cast<const VpnConnection *>(quintptr(n))
+
+void Ut_VpnStateCounter::testReadyConnectionDrops()
+{
+    VpnStateCounter counter;
+
+    QCOMPARE(counter.update(CONNECTION(1), VpnConnection::Ready), VpnConnection::Ready);
+    QCOMPARE(counter.update(CONNECTION(2), VpnConnection::Ready), VpnConnection::Ready);
+
+    // One of two drops, the other one is still ready
+    QCOMPARE(counter.update(CONNECTION(1), VpnConnection::Disconnect), VpnConnection::Ready);
+    QCOMPARE(counter.update(CONNECTION(1), VpnConnection::Idle), VpnConnection::Ready);
+
+    // The last one drops
+    QCOMPARE(counter.update(CONNECTION(2), VpnConnection::Failure), VpnConnection::Idle);
+    QCOMPARE(counter.bestState(), VpnConnection::Idle);
+}
+
+void Ut_VpnStateCounter::testRemoveReadyConnection()
+{
+    VpnStateCounter counter;
+
+    QCOMPARE(counter.update(CONNECTION(1), VpnConnection::Ready), VpnConnection::Ready);
+    QCOMPARE(counter.update(CONNECTION(2), VpnConnection::Idle), VpnConnection::Ready);
+
+    QCOMPARE(counter.remove(CONNECTION(1)), VpnConnection::Idle);
+    // Removing again or removing an unknown connection changes nothing
+    QCOMPARE(counter.remove(CONNECTION(1)), VpnConnection::Idle);
+    QCOMPARE(counter.remove(CONNECTION(3)), VpnConnection::Idle);
+
+    QCOMPARE(counter.update(CONNECTION(2), VpnConnection::Ready), VpnConnection::Ready);
+    counter.clear();
+    QCOMPARE(counter.bestState(), VpnConnection::Idle);
+}
+
+void Ut_VpnStateCounter::testConfigurationBeatsIdle()
+{
+    VpnStateCounter counter;
+
+    QCOMPARE(counter.update(CONNECTION(1), VpnConnection::Failure), VpnConnection::Idle);
+    QCOMPARE(counter.update(CONNECTION(2), VpnConnection::Configuration), VpnConnection::Configuration);
+    QCOMPARE(counter.update(CONNECTION(1), VpnConnection::Ready), VpnConnection::Ready);
+
+    // Reporting the same state twice is counted once
+    QCOMPARE(counter.update(CONNECTION(1), VpnConnection::Ready), VpnConnection::Ready);
+    QCOMPARE(counter.update(CONNECTION(1), VpnConnection::Idle), VpnConnection::Configuration);
+    QCOMPARE(counter.update(CONNECTION(2), VpnConnection::Ready), VpnConnection::Ready);
+    QCOMPARE(counter.remove(CONNECTION(2)), VpnConnection::Idle);
+}
+
+QTEST_APPLESS_MAIN(Ut_VpnStateCounter)
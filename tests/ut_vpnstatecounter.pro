@@ -0,0 +1,12 @@
+TARGET = ut_vpnstatecounter
+
+include(tests.pri)
+
+CONFIG += link_pkgconfig
+PKGCONFIG += connman-qt5
+
+SOURCES += ut_vpnstatecounter.cpp
+HEADERS += ut_vpnstatecounter.h
+
+SOURCES += ../src/vpnstatecounter.cpp
+HEADERS += ../src/vpnstatecounter_p.h